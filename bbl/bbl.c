@@ -7,6 +7,7 @@
 #include "bits.h"
 #include "config.h"
 #include "fdt.h"
+#include "boot_profile.h"
 #include "string.h"
 
 #ifdef BBL_PAYLOAD
@@ -24,7 +25,8 @@ extern char _payload_start, _payload_end; /* internal payload */
 # define PAYLOAD_END (void*)(MEM_START + 0x10000000)
 #endif
 static const void* entry_point;
-long disabled_hart_mask;
+hart_mask_t disabled_hart_mask;
+static struct fdt_filter_prop profile_props[2];
 
 static uintptr_t dtb_output()
 {
@@ -43,15 +45,34 @@ static uintptr_t dtb_output()
 
 static void filter_dtb(uintptr_t source)
 {
-  uintptr_t dest = dtb_output();
-  uint32_t size = fdt_size(source);
-  memcpy((void*)dest, (void*)source, size);
+  // The ACLINT's M-level parts go too, but its SSWI is left to S-mode
+  static const char *drop_compat[] = { "riscv,clint0", "riscv,aclint-mswi", "riscv,aclint-mtimer",
+                                       "riscv,debug-013", NULL };
+  static char profile_names[32 * BOOT_PROFILE_MAX_PHASES];
+  static uint64_t profile_counters[2 * BOOT_PROFILE_MAX_PHASES];
+  struct fdt_filter filter;
 
-  // Remove information from the chained FDT
-  filter_harts(dest, &disabled_hart_mask);
-  filter_plic(dest);
-  filter_compat(dest, "riscv,clint0");
-  filter_compat(dest, "riscv,debug-013");
+  // Pass the boot profile on in /chosen; the phases from here on are
+  // filled in to the copy at handoff
+  boot_phase_reserve("filter_dtb");
+  boot_phase_reserve("handoff");
+  profile_props[0].name = "riscv-pk,boot-phases";
+  profile_props[0].value = profile_names;
+  profile_props[0].len = boot_profile_names(profile_names, sizeof(profile_names));
+  profile_props[1].name = "riscv-pk,boot-profile";
+  profile_props[1].value = profile_counters;
+  profile_props[1].len = boot_profile_encode(profile_counters, sizeof(profile_counters));
+  assert(profile_props[0].len <= sizeof(profile_names));
+
+  // Remove information from the chained FDT while copying it
+  memset(&filter, 0, sizeof(filter));
+  filter.drop_compat = drop_compat;
+  filter.disabled_hart_mask = &disabled_hart_mask;
+  filter.redact_plic = 1;
+  filter.chosen = profile_props;
+  filter.chosen_count = 2;
+  fdt_filter(source, dtb_output(), &filter);
+  boot_phase("filter_dtb");
 }
 
 static void protect_memory(void)
@@ -120,7 +141,7 @@ void boot_other_hart(uintptr_t unused __attribute__((unused)))
   } while (!entry);
 
   long hartid = read_csr(mhartid);
-  if ((1 << hartid) & disabled_hart_mask) {
+  if (hart_mask_test(&disabled_hart_mask, hartid)) {
     while (1) {
       __asm__ volatile("wfi");
 #ifdef __riscv_div
@@ -147,6 +168,13 @@ void boot_loader(uintptr_t dtb)
 #endif
 #ifdef PK_PRINT_DEVICE_TREE
   fdt_print(dtb_output());
+#endif
+  boot_phase("handoff");
+  // Nothing to patch if the DTB couldn't be filtered
+  if (profile_props[1].out)
+    boot_profile_encode(profile_props[1].out, profile_props[1].len);
+#ifdef PK_PRINT_BOOT_PROFILE
+  boot_profile_print(printm);
 #endif
   mb();
   /* Use optional FDT preloaded external payload if present */
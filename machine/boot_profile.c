@@ -0,0 +1,90 @@
+// See LICENSE for license details.
+
+#include "boot_profile.h"
+#include "encoding.h"
+#include "string.h"
+
+struct boot_phase boot_profile[BOOT_PROFILE_MAX_PHASES];
+int boot_profile_phases;
+static int boot_profile_slots;
+
+#if __riscv_xlen == 32
+# define read_csr64(reg) ({ uint32_t hi, lo;                       \
+  do { hi = read_csr(reg##h); lo = read_csr(reg); }                 \
+  while (hi != read_csr(reg##h));                                   \
+  ((uint64_t)hi << 32) | lo; })
+#else
+# define read_csr64(reg) ((uint64_t)read_csr(reg))
+#endif
+
+void boot_phase(const char *name)
+{
+  uint64_t cycle = read_csr64(cycle);
+  uint64_t instret = read_csr64(instret);
+  int i = boot_profile_phases;
+
+  if (i < boot_profile_slots) {
+    // Reserved slots are filled in order, as their layout was already handed out
+    if (strcmp(boot_profile[i].name, name))
+      return;
+  } else if (i < BOOT_PROFILE_MAX_PHASES) {
+    boot_profile[i].name = name;
+    boot_profile_slots++;
+  } else {
+    return;
+  }
+
+  boot_profile[i].cycle = cycle;
+  boot_profile[i].instret = instret;
+  boot_profile_phases++;
+}
+
+void boot_phase_reserve(const char *name)
+{
+  if (boot_profile_slots < BOOT_PROFILE_MAX_PHASES)
+    boot_profile[boot_profile_slots++].name = name;
+}
+
+size_t boot_profile_names(char *buf, size_t len)
+{
+  size_t pos = 0;
+  for (int i = 0; i < boot_profile_slots; i++) {
+    size_t n = strlen(boot_profile[i].name) + 1;
+    if (pos + n <= len)
+      memcpy(buf + pos, boot_profile[i].name, n);
+    pos += n;
+  }
+  return pos;
+}
+
+static void put_be64(uint8_t *p, uint64_t x)
+{
+  for (int i = 7; i >= 0; i--, x >>= 8)
+    p[i] = x;
+}
+
+size_t boot_profile_encode(void *buf, size_t len)
+{
+  uint8_t *p = buf;
+  for (int i = 0; i < boot_profile_slots && 16 * (i+1) <= len; i++) {
+    put_be64(p + 16*i, boot_profile[i].cycle);
+    put_be64(p + 16*i + 8, boot_profile[i].instret);
+  }
+  return 16 * boot_profile_slots;
+}
+
+void boot_profile_print(void (*print)(const char *, ...))
+{
+  uint64_t cycle = 0, instret = 0;
+
+  print("boot profile (cycles, instructions since the previous phase):\r\n");
+  for (int i = 0; i < boot_profile_phases; i++) {
+    print("  %s: %lld cycles, %lld instructions\r\n", boot_profile[i].name,
+          (long long)(boot_profile[i].cycle - cycle),
+          (long long)(boot_profile[i].instret - instret));
+    cycle = boot_profile[i].cycle;
+    instret = boot_profile[i].instret;
+  }
+  print("  total: %lld cycles, %lld instructions\r\n",
+        (long long)cycle, (long long)instret);
+}
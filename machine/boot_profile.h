@@ -0,0 +1,35 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_BOOT_PROFILE_H
+#define _RISCV_BOOT_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOOT_PROFILE_MAX_PHASES 16
+
+// Counter values taken at the end of a boot phase
+struct boot_phase {
+  const char *name;
+  uint64_t cycle;
+  uint64_t instret;
+};
+
+extern struct boot_phase boot_profile[BOOT_PROFILE_MAX_PHASES];
+extern int boot_profile_phases;
+
+// Timestamp the end of the named phase; phases past the table are dropped
+void boot_phase(const char *name);
+// Hold a slot for a phase still to come, so the table can be exported first
+void boot_phase_reserve(const char *name);
+
+// Export the table, reserved slots included, in the layout of the
+// "riscv-pk,boot-phases" (string list) and "riscv-pk,boot-profile"
+// (big-endian 64-bit cycle and instret per phase) properties.
+// Both return the full size, even if it did not fit in len.
+size_t boot_profile_names(char *buf, size_t len);
+size_t boot_profile_encode(void *buf, size_t len);
+
+void boot_profile_print(void (*print)(const char *, ...));
+
+#endif
@@ -2,5 +2,6 @@
 
 #ifndef DISABLED_HART_MASK_H
 #define DISABLED_HART_MASK_H
-extern long disabled_hart_mask;
+#include "mtrap.h"
+extern hart_mask_t disabled_hart_mask;
 #endif
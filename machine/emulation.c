@@ -5,6 +5,7 @@
 #include "config.h"
 #include "unprivileged_memory.h"
 #include "mtrap.h"
+#include "mstats.h"
 #include <limits.h>
 
 static DECLARE_EMULATION_FUNC(emulate_rvc)
@@ -72,6 +73,90 @@ static DECLARE_EMULATION_FUNC(emulate_rvc)
   return truly_illegal_insn(regs, mcause, mepc, mstatus, insn);
 }
 
+// Instructions that the hardware lacks and that do not jump: once one of
+// them has trapped, those that follow are emulated in the same trap.
+#define EMULATION_RUN_MAX 16
+
+static int emulation_continues(insn_t insn)
+{
+#if !defined(__riscv_flen) && defined(PK_ENABLE_FP_EMULATION)
+  if ((insn & 3) != 3) {
+# ifdef __riscv_compressed
+    if ((insn & MASK_C_FLD) == MATCH_C_FLD || (insn & MASK_C_FLDSP) == MATCH_C_FLDSP ||
+        (insn & MASK_C_FSD) == MATCH_C_FSD || (insn & MASK_C_FSDSP) == MATCH_C_FSDSP)
+      return 1;
+#  if __riscv_xlen == 32
+    if ((insn & MASK_C_FLW) == MATCH_C_FLW || (insn & MASK_C_FLWSP) == MATCH_C_FLWSP ||
+        (insn & MASK_C_FSW) == MATCH_C_FSW || (insn & MASK_C_FSWSP) == MATCH_C_FSWSP)
+      return 1;
+#  endif
+# endif
+    return 0;
+  }
+#endif
+
+  switch (insn & 0x7f)
+  {
+#if !defined(__riscv_muldiv)
+    case MATCH_MUL & 0x7f:
+      return (insn & 0xfe00007f) == MATCH_MUL;
+# if __riscv_xlen >= 64
+    case MATCH_MULW & 0x7f:
+      return (insn & 0xfe00007f) == MATCH_MULW;
+# endif
+#endif
+#if !defined(__riscv_flen) && defined(PK_ENABLE_FP_EMULATION)
+    case MATCH_FLW & 0x7f:
+    case MATCH_FSW & 0x7f:
+    case MATCH_FMADD_S & 0x7f:
+    case MATCH_FMSUB_S & 0x7f:
+    case MATCH_FNMSUB_S & 0x7f:
+    case MATCH_FNMADD_S & 0x7f:
+    case MATCH_FADD_S & 0x7f:
+      return 1;
+#endif
+  }
+  return 0;
+}
+
+// An instruction that has been emulated, rather than redirected, by class
+static int emulation_counter(insn_t insn)
+{
+  if ((insn & 3) != 3)
+    return MSTATS_EMUL_FP;
+  switch (insn & 0x7f)
+  {
+    case MATCH_MUL & 0x7f:
+    case MATCH_MULW & 0x7f:
+      return MSTATS_EMUL_MULDIV;
+    case MATCH_CSRRW & 0x7f:
+      return MSTATS_EMUL_CSR;
+  }
+  return MSTATS_EMUL_FP;
+}
+
+static void emulate_insn(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc, uintptr_t mstatus, insn_t insn)
+{
+  uintptr_t start = mstats_begin();
+
+  if ((insn & 3) != 3) {
+    emulate_rvc(regs, mcause, mepc, mstatus, insn);
+    return mstats_end(emulation_counter(insn), start);
+  }
+
+#if __has_feature(capabilities)
+  write_scr(mepcc, mepc + 4);
+#else
+  write_csr(mepc, mepc + 4);
+#endif
+
+  extern uint32_t illegal_insn_trap_table[];
+  int32_t* pf = (void*)illegal_insn_trap_table + (insn & 0x7c);
+  emulation_func f = (emulation_func)ptr_to_pcccap((void*)illegal_insn_trap_table + *pf);
+  f(regs, mcause, mepc, mstatus, insn);
+  mstats_end(emulation_counter(insn), start);
+}
+
 void illegal_insn_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
 {
   asm (".pushsection .rodata\n"
@@ -140,28 +225,35 @@ void illegal_insn_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
   uintptr_t mstatus = read_csr(mstatus);
   insn_t insn = read_csr(mtval);
 
-  if (unlikely((insn & 3) != 3)) {
-    if (insn == 0)
-      insn = get_insn(mepc, &mstatus);
-    if ((insn & 3) != 3)
-      return emulate_rvc(regs, mcause, mepc, mstatus, insn);
-  }
+  // Instructions are fetched afresh rather than cached by pc: S-mode's own
+  // fence.i and sfence.vma do not trap, so M-mode cannot see a cache go stale.
+  if (unlikely((insn & 3) != 3) && insn == 0)
+    insn = get_insn(mepc, &mstatus);
 
+  emulate_insn(regs, mcause, mepc, mstatus, insn);
+  if (!emulation_continues(insn))
+    return;
+
+  // Anything but an emulated instruction redirects the trap, so getting
+  // here means the run continues at the new mepc.  A pending interrupt
+  // ends it early.
+  for (int i = 1; i < EMULATION_RUN_MAX && !(read_csr(mip) & read_csr(mie)); i++) {
 #if __has_feature(capabilities)
-  write_scr(mepcc, mepc + 4);
+    mepc = read_scr(mepcc);
 #else
-  write_csr(mepc, mepc + 4);
+    mepc = read_csr(mepc);
 #endif
-
-  extern uint32_t illegal_insn_trap_table[];
-  int32_t* pf = (void*)illegal_insn_trap_table + (insn & 0x7c);
-  emulation_func f = (emulation_func)ptr_to_pcccap((void*)illegal_insn_trap_table + *pf);
-  f(regs, mcause, mepc, mstatus, insn);
+    insn = get_insn(mepc, &mstatus);
+    if (!emulation_continues(insn))
+      return;
+    emulate_insn(regs, mcause, mepc, mstatus, insn);
+  }
 }
 
 __attribute__((noinline))
 DECLARE_EMULATION_FUNC(truly_illegal_insn)
 {
+  mstats_count(MSTATS_ILLEGAL);
   return redirect_trap(mepc, mstatus, insn);
 }
 
@@ -108,9 +108,21 @@
 #define MIP_SEIP            (1 << IRQ_S_EXT)
 #define MIP_HEIP            (1 << IRQ_H_EXT)
 #define MIP_MEIP            (1 << IRQ_M_EXT)
+#define MIP_LCOFIP          (1 << IRQ_LCOF)
+
+#define MENVCFG_STCE        0x8000000000000000
+#define MENVCFGH_STCE       0x80000000
+
+#define MHPMEVENT_OF        0x8000000000000000
+#define MHPMEVENT_MINH      0x4000000000000000
+#define MHPMEVENT_SINH      0x2000000000000000
+#define MHPMEVENT_UINH      0x1000000000000000
+#define MHPMEVENT_VSINH     0x0800000000000000
+#define MHPMEVENT_VUINH     0x0400000000000000
 
 #define SIP_SSIP MIP_SSIP
 #define SIP_STIP MIP_STIP
+#define SIP_LCOFIP MIP_LCOFIP
 
 #define PRV_U 0
 #define PRV_S 1
@@ -152,7 +164,7 @@
 #define IRQ_H_EXT    10
 #define IRQ_M_EXT    11
 #define IRQ_COP      12
-#define IRQ_HOST     13
+#define IRQ_LCOF     13
 
 #define DEFAULT_RSTVEC     0x00001000
 #define CLINT_BASE         0x02000000
@@ -819,6 +831,8 @@
 #define CSR_SCAUSE 0x142
 #define CSR_STVAL 0x143
 #define CSR_SIP 0x144
+#define CSR_STIMECMP 0x14d
+#define CSR_STIMECMPH 0x15d
 #define CSR_SATP 0x180
 #define CSR_MSTATUS 0x300
 #define CSR_MISA 0x301
@@ -827,6 +841,8 @@
 #define CSR_MIE 0x304
 #define CSR_MTVEC 0x305
 #define CSR_MCOUNTEREN 0x306
+#define CSR_MENVCFG 0x30a
+#define CSR_MENVCFGH 0x31a
 #define CSR_MSCRATCH 0x340
 #define CSR_MEPC 0x341
 #define CSR_MCAUSE 0x342
@@ -1311,6 +1327,8 @@ DECLARE_CSR(sepc, CSR_SEPC)
 DECLARE_CSR(scause, CSR_SCAUSE)
 DECLARE_CSR(stval, CSR_STVAL)
 DECLARE_CSR(sip, CSR_SIP)
+DECLARE_CSR(stimecmp, CSR_STIMECMP)
+DECLARE_CSR(stimecmph, CSR_STIMECMPH)
 DECLARE_CSR(satp, CSR_SATP)
 DECLARE_CSR(mstatus, CSR_MSTATUS)
 DECLARE_CSR(misa, CSR_MISA)
@@ -1319,6 +1337,8 @@ DECLARE_CSR(mideleg, CSR_MIDELEG)
 DECLARE_CSR(mie, CSR_MIE)
 DECLARE_CSR(mtvec, CSR_MTVEC)
 DECLARE_CSR(mcounteren, CSR_MCOUNTEREN)
+DECLARE_CSR(menvcfg, CSR_MENVCFG)
+DECLARE_CSR(menvcfgh, CSR_MENVCFGH)
 DECLARE_CSR(mscratch, CSR_MSCRATCH)
 DECLARE_CSR(mepc, CSR_MEPC)
 DECLARE_CSR(mcause, CSR_MCAUSE)
@@ -6,6 +6,13 @@
 #include "config.h"
 #include "fdt.h"
 #include "mtrap.h"
+#ifdef PK_STATIC_PLATFORM
+#include "platform_profile.h"
+#include "uart.h"
+#include "uart16550.h"
+#include "htif.h"
+#include "finisher.h"
+#endif
 
 static inline uint32_t bswap(uint32_t x)
 {
@@ -27,20 +34,100 @@ static inline int isstring(char c)
   return 0;
 }
 
+static const char *fdt_prop_names[FDT_PROP_COUNT] = {
+#define FDT_PROP_STRING(id, name) name,
+  FDT_PROP_NAMES(FDT_PROP_STRING)
+#undef FDT_PROP_STRING
+};
+
+#define FDT_INDEX_MAX_NODES	256
+#define FDT_INDEX_MAX_DEPTH	32
+#define FDT_NAME_MISSING	0xffffffff
+#define FDT_NAME_AMBIGUOUS	0xfffffffe
+
+struct fdt_index_node {
+  uint32_t offset;      // of the FDT_BEGIN_NODE token
+  int16_t parent;
+  uint8_t address_cells;
+  uint8_t size_cells;
+  uint32_t phandle;
+  uint32_t compat;      // offset of the compatible value, 0 if none
+  uint32_t compat_len;
+  uint32_t device_type; // offset of the device_type value, 0 if none
+};
+
+static struct {
+  // Where the indexed FDT is, and its layout; copies elsewhere are scanned
+  uintptr_t base;
+  uint32_t totalsize;
+  uint32_t off_dt_struct;
+  uint32_t off_dt_strings;
+  uint32_t size_dt_strings;
+  int nodes;
+  uint32_t names[FDT_PROP_COUNT];
+  struct fdt_index_node node[FDT_INDEX_MAX_NODES];
+} fdt_idx;
+
+// Set at the start of each scan: property names may be compared by offset
+static bool fdt_scan_indexed;
+
+static bool fdt_index_matches(uintptr_t fdt)
+{
+  struct fdt_header *header = (struct fdt_header *)fdt;
+  return fdt_idx.nodes > 0 &&
+         fdt == fdt_idx.base &&
+         bswap(header->totalsize)       == fdt_idx.totalsize &&
+         bswap(header->off_dt_struct)   == fdt_idx.off_dt_struct &&
+         bswap(header->off_dt_strings)  == fdt_idx.off_dt_strings &&
+         bswap(header->size_dt_strings) == fdt_idx.size_dt_strings;
+}
+
+int fdt_prop_is(const struct fdt_scan_prop *prop, enum fdt_prop_id id)
+{
+  if (fdt_scan_indexed && fdt_idx.names[id] != FDT_NAME_AMBIGUOUS)
+    return prop->nameoff == fdt_idx.names[id];
+  return !strcmp(prop->name, fdt_prop_names[id]);
+}
+
 static uint32_t *fdt_scan_helper(
+  uint32_t *lex,
+  const char *strings,
+  struct fdt_scan_node *node,
+  const struct fdt_cb *cb);
+
+static uint32_t *fdt_scan_child(
   uint32_t *lex,
   const char *strings,
   struct fdt_scan_node *node,
   const struct fdt_cb *cb)
 {
   struct fdt_scan_node child;
-  struct fdt_scan_prop prop;
-  int last = 0;
+  uint32_t *lex_next;
 
   child.parent = node;
+  child.name = (const char *)(lex+1);
   // these are the default cell counts, as per the FDT spec
   child.address_cells = 2;
   child.size_cells = 1;
+
+  if (cb->open) cb->open(&child, cb->extra);
+  lex_next = fdt_scan_helper(
+    lex + 2 + strlen(child.name)/4,
+    strings, &child, cb);
+  if (cb->close && cb->close(&child, cb->extra) == -1)
+    while (lex != lex_next) *lex++ = bswap(FDT_NOP);
+  return lex_next;
+}
+
+static uint32_t *fdt_scan_helper(
+  uint32_t *lex,
+  const char *strings,
+  struct fdt_scan_node *node,
+  const struct fdt_cb *cb)
+{
+  struct fdt_scan_prop prop;
+  int last = 0;
+
   prop.node = node;
 
   while (1) {
@@ -51,27 +138,20 @@ static uint32_t *fdt_scan_helper(
       }
       case FDT_PROP: {
         assert (!last);
-        prop.name  = strings + bswap(lex[2]);
+        prop.nameoff = bswap(lex[2]);
+        prop.name  = strings + prop.nameoff;
         prop.len   = bswap(lex[1]);
         prop.value = lex + 3;
-        if (node && !strcmp(prop.name, "#address-cells")) { node->address_cells = bswap(lex[3]); }
-        if (node && !strcmp(prop.name, "#size-cells"))    { node->size_cells    = bswap(lex[3]); }
+        if (node && fdt_prop_is(&prop, FDT_PROP_ADDRESS_CELLS)) { node->address_cells = bswap(lex[3]); }
+        if (node && fdt_prop_is(&prop, FDT_PROP_SIZE_CELLS))    { node->size_cells    = bswap(lex[3]); }
         lex += 3 + (prop.len+3)/4;
         cb->prop(&prop, cb->extra);
         break;
       }
       case FDT_BEGIN_NODE: {
-        uint32_t *lex_next;
         if (!last && node && cb->done) cb->done(node, cb->extra);
         last = 1;
-        child.name = (const char *)(lex+1);
-        if (cb->open) cb->open(&child, cb->extra);
-        lex_next = fdt_scan_helper(
-          lex + 2 + strlen(child.name)/4,
-          strings, &child, cb);
-        if (cb->close && cb->close(&child, cb->extra) == -1)
-          while (lex != lex_next) *lex++ = bswap(FDT_NOP);
-        lex = lex_next;
+        lex = fdt_scan_child(lex, strings, node, cb);
         break;
       }
       case FDT_END_NODE: {
@@ -97,6 +177,7 @@ void fdt_scan(uintptr_t fdt, const struct fdt_cb *cb)
   const char *strings = (const char *)(fdt + bswap(header->off_dt_strings));
   uint32_t *lex = (uint32_t *)(fdt + bswap(header->off_dt_struct));
 
+  fdt_scan_indexed = fdt_index_matches(fdt);
   fdt_scan_helper(lex, strings, 0, cb);
 }
 
@@ -110,6 +191,289 @@ uint32_t fdt_size(uintptr_t fdt)
   return bswap(header->totalsize);
 }
 
+static int string_list_index(const char *list, int len, const char *str)
+{
+  const char *end = list + len;
+  int index = 0;
+  while (end - list > 0) {
+    if (!strcmp(list, str)) return index;
+    ++index;
+    list += strlen(list) + 1;
+  }
+  return -1;
+}
+
+/////////////////////////////////////////////// INDEX ///////////////////////////////////////////
+
+static int fdt_index_name(const char *strings, uint32_t nameoff)
+{
+  for (int id = 0; id < FDT_PROP_COUNT; ++id)
+    if (fdt_idx.names[id] == nameoff)
+      return id;
+
+  // First sighting of this offset; a name found at two offsets falls back to strcmp
+  for (int id = 0; id < FDT_PROP_COUNT; ++id) {
+    if (!strcmp(strings + nameoff, fdt_prop_names[id])) {
+      fdt_idx.names[id] = fdt_idx.names[id] == FDT_NAME_MISSING ? nameoff : FDT_NAME_AMBIGUOUS;
+      return id;
+    }
+  }
+  return -1;
+}
+
+void fdt_index(uintptr_t fdt)
+{
+  struct fdt_header *header = (struct fdt_header *)fdt;
+  int stack[FDT_INDEX_MAX_DEPTH];
+  int depth = 0;
+
+  fdt_idx.nodes = 0;
+  if (bswap(header->magic) != FDT_MAGIC ||
+      bswap(header->last_comp_version) > FDT_VERSION) return;
+
+  const char *strings = (const char *)(fdt + bswap(header->off_dt_strings));
+  uint32_t *lex = (uint32_t *)(fdt + bswap(header->off_dt_struct));
+  int nodes = 0;
+
+  for (int id = 0; id < FDT_PROP_COUNT; ++id)
+    fdt_idx.names[id] = FDT_NAME_MISSING;
+
+  while (1) {
+    switch (bswap(lex[0])) {
+      case FDT_NOP: {
+        lex += 1;
+        break;
+      }
+      case FDT_PROP: {
+        uint32_t len = bswap(lex[1]);
+        struct fdt_index_node *cur;
+        if (depth == 0) return;
+        cur = &fdt_idx.node[stack[depth-1]];
+        switch (fdt_index_name(strings, bswap(lex[2]))) {
+          case FDT_PROP_ADDRESS_CELLS: cur->address_cells = bswap(lex[3]); break;
+          case FDT_PROP_SIZE_CELLS:    cur->size_cells = bswap(lex[3]); break;
+          case FDT_PROP_PHANDLE:
+          case FDT_PROP_LINUX_PHANDLE: cur->phandle = bswap(lex[3]); break;
+          case FDT_PROP_COMPATIBLE:
+            cur->compat = (uintptr_t)(lex + 3) - fdt;
+            cur->compat_len = len;
+            break;
+          case FDT_PROP_DEVICE_TYPE:   cur->device_type = (uintptr_t)(lex + 3) - fdt; break;
+        }
+        lex += 3 + (len+3)/4;
+        break;
+      }
+      case FDT_BEGIN_NODE: {
+        struct fdt_index_node *cur = &fdt_idx.node[nodes];
+        // Too big to index: every lookup falls back to a full scan
+        if (nodes == FDT_INDEX_MAX_NODES || depth == FDT_INDEX_MAX_DEPTH) return;
+        memset(cur, 0, sizeof(*cur));
+        cur->offset = (uintptr_t)lex - fdt;
+        cur->parent = depth ? stack[depth-1] : -1;
+        cur->address_cells = 2;
+        cur->size_cells = 1;
+        stack[depth++] = nodes++;
+        lex += 2 + strlen((const char *)(lex+1))/4;
+        break;
+      }
+      case FDT_END_NODE: {
+        if (depth == 0) return;
+        --depth;
+        lex += 1;
+        break;
+      }
+      default: { // FDT_END
+        fdt_idx.base            = fdt;
+        fdt_idx.totalsize       = bswap(header->totalsize);
+        fdt_idx.off_dt_struct   = bswap(header->off_dt_struct);
+        fdt_idx.off_dt_strings  = bswap(header->off_dt_strings);
+        fdt_idx.size_dt_strings = bswap(header->size_dt_strings);
+        fdt_idx.nodes = nodes;
+        return;
+      }
+    }
+  }
+}
+
+// The node's FDT_BEGIN_NODE token, or NULL if it has since been filtered out
+static uint32_t *fdt_index_lex(uintptr_t fdt, int node)
+{
+  uint32_t *lex = (uint32_t *)(fdt + fdt_idx.node[node].offset);
+  return bswap(lex[0]) == FDT_BEGIN_NODE ? lex : NULL;
+}
+
+static const char *fdt_index_name_of(uintptr_t fdt, int node)
+{
+  return (const char *)(fdt + fdt_idx.node[node].offset + 4);
+}
+
+// "cpus" matches "cpus", "cpu" matches "cpu@0" unless a unit address was given
+static bool fdt_name_matches(const char *name, const char *component, size_t len)
+{
+  bool unit = false;
+  for (size_t i = 0; i < len; ++i) {
+    if (name[i] != component[i]) return false;
+    unit |= component[i] == '@';
+  }
+  return name[len] == 0 || (name[len] == '@' && !unit);
+}
+
+int fdt_node_by_path(uintptr_t fdt, const char *path)
+{
+  int node = 0; // the root is always the first node
+
+  if (!fdt_index_matches(fdt) || path[0] != '/') return -1;
+
+  while (1) {
+    const char *end;
+    size_t len;
+    int child;
+
+    while (*path == '/') ++path;
+    if (!*path) return node;
+    for (end = path; *end && *end != '/'; ++end);
+    len = end - path;
+
+    for (child = node + 1; child < fdt_idx.nodes; ++child)
+      if (fdt_idx.node[child].parent == node &&
+          fdt_name_matches(fdt_index_name_of(fdt, child), path, len))
+        break;
+    if (child == fdt_idx.nodes) return -1;
+    node = child;
+    path = end;
+  }
+}
+
+int fdt_node_by_phandle(uintptr_t fdt, uint32_t phandle)
+{
+  if (!fdt_index_matches(fdt) || phandle == 0) return -1;
+  for (int node = 0; node < fdt_idx.nodes; ++node)
+    if (fdt_idx.node[node].phandle == phandle)
+      return node;
+  return -1;
+}
+
+static bool fdt_index_compatible(uintptr_t fdt, int node, const char *compat)
+{
+  const struct fdt_index_node *n = &fdt_idx.node[node];
+  return n->compat && string_list_index((const char *)(fdt + n->compat), n->compat_len, compat) >= 0;
+}
+
+int fdt_node_by_compatible(uintptr_t fdt, const char *compat, int prev)
+{
+  if (!fdt_index_matches(fdt)) return -1;
+  for (int node = prev + 1; node < fdt_idx.nodes; ++node)
+    if (fdt_index_compatible(fdt, node, compat))
+      return node;
+  return -1;
+}
+
+const uint32_t *fdt_node_prop(uintptr_t fdt, int node, enum fdt_prop_id id, int *len)
+{
+  struct fdt_header *header = (struct fdt_header *)fdt;
+  const char *strings = (const char *)(fdt + bswap(header->off_dt_strings));
+  uint32_t *lex;
+
+  if (node < 0 || !fdt_index_matches(fdt) || !(lex = fdt_index_lex(fdt, node))) return NULL;
+  lex += 2 + strlen((const char *)(lex+1))/4;
+
+  fdt_scan_indexed = true;
+  while (1) {
+    switch (bswap(lex[0])) {
+      case FDT_NOP: {
+        lex += 1;
+        break;
+      }
+      case FDT_PROP: {
+        struct fdt_scan_prop prop;
+        prop.nameoff = bswap(lex[2]);
+        prop.name = strings + prop.nameoff;
+        if (fdt_prop_is(&prop, id)) {
+          if (len) *len = bswap(lex[1]);
+          return lex + 3;
+        }
+        lex += 3 + (bswap(lex[1])+3)/4;
+        break;
+      }
+      default: // properties always precede child nodes
+        return NULL;
+    }
+  }
+}
+
+// Scan one indexed node, returning the end of its subtree
+static uint32_t *fdt_scan_indexed_node(uintptr_t fdt, int node, const struct fdt_cb *cb)
+{
+  struct fdt_header *header = (struct fdt_header *)fdt;
+  const char *strings = (const char *)(fdt + bswap(header->off_dt_strings));
+  const struct fdt_index_node *n = &fdt_idx.node[node];
+  struct fdt_scan_node parent;
+  uint32_t *lex = fdt_index_lex(fdt, node);
+
+  if (!lex) return NULL;
+  fdt_scan_indexed = true;
+  if (n->parent < 0)
+    return fdt_scan_child(lex, strings, NULL, cb);
+
+  // The callbacks only see the parent for its cell counts
+  parent.parent = NULL;
+  parent.name = fdt_index_name_of(fdt, n->parent);
+  parent.address_cells = fdt_idx.node[n->parent].address_cells;
+  parent.size_cells = fdt_idx.node[n->parent].size_cells;
+  return fdt_scan_child(lex, strings, &parent, cb);
+}
+
+void fdt_scan_node(uintptr_t fdt, int node, const struct fdt_cb *cb)
+{
+  if (node >= 0 && fdt_index_matches(fdt))
+    fdt_scan_indexed_node(fdt, node, cb);
+}
+
+void fdt_scan_path(uintptr_t fdt, const char *path, const struct fdt_cb *cb)
+{
+  if (!fdt_index_matches(fdt)) {
+    fdt_scan(fdt, cb);
+    return;
+  }
+  fdt_scan_node(fdt, fdt_node_by_path(fdt, path), cb);
+}
+
+// Scan every indexed node accepted by match(), skipping nodes inside a subtree already scanned
+static void fdt_scan_matching(uintptr_t fdt, bool (*match)(uintptr_t, int, const char *),
+                              const char *key, const struct fdt_cb *cb)
+{
+  uintptr_t end = 0;
+
+  if (!fdt_index_matches(fdt)) {
+    fdt_scan(fdt, cb);
+    return;
+  }
+
+  for (int node = 0; node < fdt_idx.nodes; ++node) {
+    if (fdt + fdt_idx.node[node].offset < end || !match(fdt, node, key)) continue;
+    uint32_t *lex_next = fdt_scan_indexed_node(fdt, node, cb);
+    if (lex_next) end = (uintptr_t)lex_next;
+  }
+}
+
+static bool fdt_index_device_type(uintptr_t fdt, int node, const char *type)
+{
+  const struct fdt_index_node *n = &fdt_idx.node[node];
+  return n->device_type && !strcmp((const char *)(fdt + n->device_type), type);
+}
+
+void fdt_scan_compatible(uintptr_t fdt, const char *compat, const struct fdt_cb *cb)
+{
+  fdt_scan_matching(fdt, fdt_index_compatible, compat, cb);
+}
+
+void fdt_scan_device_type(uintptr_t fdt, const char *type, const struct fdt_cb *cb)
+{
+  fdt_scan_matching(fdt, fdt_index_device_type, type, cb);
+}
+
+//////////////////////////////////////////// ACCESSORS //////////////////////////////////////////
+
 const uint32_t *fdt_get_address(const struct fdt_scan_node *node, const uint32_t *value, uint64_t *result)
 {
   *result = 0;
@@ -131,17 +495,14 @@ uint32_t fdt_get_value(const struct fdt_scan_prop *prop, uint32_t index)
   return bswap(prop->value[index]);
 }
 
+uint32_t fdt_cell(const uint32_t *value)
+{
+  return bswap(*value);
+}
+
 int fdt_string_list_index(const struct fdt_scan_prop *prop, const char *str)
 {
-  const char *list = (const char *)prop->value;
-  const char *end = list + prop->len;
-  int index = 0;
-  while (end - list > 0) {
-    if (!strcmp(list, str)) return index;
-    ++index;
-    list += strlen(list) + 1;
-  }
-  return -1;
+  return string_list_index((const char *)prop->value, prop->len, str);
 }
 
 void fdt_version_prop_print(const uint32_t *version_value, int version_len)
@@ -177,9 +538,9 @@ static void mem_open(const struct fdt_scan_node *node, void *extra)
 static void mem_prop(const struct fdt_scan_prop *prop, void *extra)
 {
   struct mem_scan *scan = (struct mem_scan *)extra;
-  if (!strcmp(prop->name, "device_type") && !strcmp((const char*)prop->value, "memory")) {
+  if (fdt_prop_is(prop, FDT_PROP_DEVICE_TYPE) && !strcmp((const char*)prop->value, "memory")) {
     scan->memory = 1;
-  } else if (!strcmp(prop->name, "reg")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_REG)) {
     scan->reg_value = prop->value;
     scan->reg_len = prop->len;
   }
@@ -216,7 +577,7 @@ void query_mem(uintptr_t fdt)
   cb.extra = &scan;
 
   mem_size = 0;
-  fdt_scan(fdt, &cb);
+  fdt_scan_device_type(fdt, "memory", &cb);
   assert (mem_size > 0);
 }
 
@@ -239,7 +600,7 @@ static void root_open(const struct fdt_scan_node *node, void *extra)
 static void root_prop(const struct fdt_scan_prop *prop, void *extra)
 {
   struct root_scan *scan = (struct root_scan *)extra;
-  if (!strcmp(prop->name, "sri-cambridge,version") && !scan->version_value) {
+  if (fdt_prop_is(prop, FDT_PROP_SOC_VERSION) && !scan->version_value) {
     scan->version_value = prop->value;
     scan->version_len = prop->len;
   }
@@ -260,6 +621,15 @@ void query_root(uintptr_t fdt)
   struct fdt_cb cb;
   struct root_scan scan;
 
+  int root = fdt_node_by_path(fdt, "/");
+  if (root >= 0) {
+    int len = 0;
+    const uint32_t *version = fdt_node_prop(fdt, root, FDT_PROP_SOC_VERSION, &len);
+    printm("SoC version: ");
+    fdt_version_prop_print(version, len);
+    return;
+  }
+
   memset(&cb, 0, sizeof(cb));
   memset(&scan, 0, sizeof(scan));
   cb.open = root_open;
@@ -273,7 +643,7 @@ void query_root(uintptr_t fdt)
 ///////////////////////////////////////////// HART SCAN //////////////////////////////////////////
 
 static uint32_t hart_phandles[MAX_HARTS];
-uint64_t hart_mask;
+hart_mask_t hart_mask;
 
 struct hart_scan {
   const struct fdt_scan_node *cpu;
@@ -283,8 +653,24 @@ struct hart_scan {
   uint32_t phandle;
   const uint32_t *version_value;
   int version_len;
+  int sstc;
 };
 
+// Whether an ISA string such as "rv64imafdc_sstc" names a multi-letter extension
+static int isa_has_extension(const char *isa, const char *ext)
+{
+  for (const char *p = isa; *p; p++) {
+    if (*p != '_')
+      continue;
+    size_t i = 0;
+    while (ext[i] && p[1 + i] == ext[i])
+      i++;
+    if (!ext[i] && (p[1 + i] == '_' || p[1 + i] == '\0'))
+      return 1;
+  }
+  return 0;
+}
+
 static void hart_open(const struct fdt_scan_node *node, void *extra)
 {
   struct hart_scan *scan = (struct hart_scan *)extra;
@@ -292,6 +678,7 @@ static void hart_open(const struct fdt_scan_node *node, void *extra)
     scan->hart = -1;
     scan->version_value = NULL;
     scan->version_len = 0;
+    scan->sstc = 0;
   }
   if (!scan->controller) {
     scan->cells = 0;
@@ -302,23 +689,27 @@ static void hart_open(const struct fdt_scan_node *node, void *extra)
 static void hart_prop(const struct fdt_scan_prop *prop, void *extra)
 {
   struct hart_scan *scan = (struct hart_scan *)extra;
-  if (!strcmp(prop->name, "device_type") && !strcmp((const char*)prop->value, "cpu")) {
+  if (fdt_prop_is(prop, FDT_PROP_DEVICE_TYPE) && !strcmp((const char*)prop->value, "cpu")) {
     assert (!scan->cpu);
     scan->cpu = prop->node;
-  } else if (!strcmp(prop->name, "interrupt-controller")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_INTERRUPT_CONTROLLER)) {
     assert (!scan->controller);
     scan->controller = prop->node;
-  } else if (!strcmp(prop->name, "#interrupt-cells")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_INTERRUPT_CELLS)) {
     scan->cells = bswap(prop->value[0]);
-  } else if (!strcmp(prop->name, "phandle")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_PHANDLE)) {
     scan->phandle = bswap(prop->value[0]);
-  } else if (!strcmp(prop->name, "reg")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_REG)) {
     uint64_t reg;
     fdt_get_address(prop->node->parent, prop->value, &reg);
     scan->hart = reg;
-  } else if (!strcmp(prop->name, "sri-cambridge,version")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_SOC_VERSION)) {
     scan->version_value = prop->value;
     scan->version_len = prop->len;
+  } else if (fdt_prop_is(prop, FDT_PROP_RISCV_ISA)) {
+    scan->sstc |= isa_has_extension((const char *)prop->value, "sstc");
+  } else if (fdt_prop_is(prop, FDT_PROP_RISCV_ISA_EXTENSIONS)) {
+    scan->sstc |= fdt_string_list_index(prop, "sstc") >= 0;
   }
 }
 
@@ -338,8 +729,8 @@ static void hart_done(const struct fdt_scan_node *node, void *extra)
 
     if (scan->hart < MAX_HARTS) {
       hart_phandles[scan->hart] = scan->phandle;
-      hart_mask |= 1 << scan->hart;
-      hls_init(scan->hart);
+      hart_mask_set(&hart_mask, scan->hart);
+      hls_init(scan->hart)->sstc = scan->sstc;
     }
   }
 }
@@ -365,10 +756,10 @@ void query_harts(uintptr_t fdt)
   cb.close= hart_close;
   cb.extra = &scan;
 
-  fdt_scan(fdt, &cb);
+  fdt_scan_device_type(fdt, "cpu", &cb);
 
   // The current hart should have been detected
-  assert ((hart_mask >> read_csr(mhartid)) != 0);
+  assert (hart_mask_test(&hart_mask, read_csr(mhartid)));
 }
 
 ///////////////////////////////////////////// CLINT SCAN /////////////////////////////////////////
@@ -390,25 +781,60 @@ static void clint_open(const struct fdt_scan_node *node, void *extra)
   scan->int_value = 0;
 }
 
+#define CLINT_COMPAT 1
+#define SSWI_COMPAT  2
+
 static void clint_prop(const struct fdt_scan_prop *prop, void *extra)
 {
   struct clint_scan *scan = (struct clint_scan *)extra;
-  if (!strcmp(prop->name, "compatible") && fdt_string_list_index(prop, "riscv,clint0") >= 0) {
-    scan->compat = 1;
-  } else if (!strcmp(prop->name, "reg")) {
+  if (fdt_prop_is(prop, FDT_PROP_COMPATIBLE) && fdt_string_list_index(prop, "riscv,clint0") >= 0) {
+    scan->compat = CLINT_COMPAT;
+  } else if (fdt_prop_is(prop, FDT_PROP_COMPATIBLE) && fdt_string_list_index(prop, "riscv,aclint-sswi") >= 0) {
+    scan->compat = SSWI_COMPAT;
+  } else if (fdt_prop_is(prop, FDT_PROP_REG)) {
     fdt_get_address(prop->node->parent, prop->value, &scan->reg);
-  } else if (!strcmp(prop->name, "interrupts-extended")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_INTERRUPTS_EXTENDED)) {
     scan->int_value = prop->value;
     scan->int_len = prop->len;
   }
 }
 
+static void clint_hart(int hart, uintptr_t reg, int index)
+{
+  hls_t *hls = OTHER_HLS(hart);
+  hls->ipi = ptr_to_ddccap((void*)(reg + index * 4));
+  hls->timecmp = ptr_to_ddccap((void*)(reg + 0x4000 + (index * 8)));
+}
+
+// An ACLINT SSWI raises a hart's SSIP directly from a 4-byte register,
+// wired to the hart's supervisor software interrupt
+static void sswi_done(struct clint_scan *scan)
+{
+  const uint32_t *value = scan->int_value;
+  const uint32_t *end = value + scan->int_len/4;
+
+  assert (scan->reg != 0);
+  assert (scan->int_value && scan->int_len % 8 == 0);
+
+  for (int index = 0; end - value > 0; ++index) {
+    uint32_t phandle = bswap(value[0]);
+    int hart;
+    for (hart = 0; hart < MAX_HARTS; ++hart)
+      if (hart_phandles[hart] == phandle)
+        break;
+    if (hart < MAX_HARTS && bswap(value[1]) == IRQ_S_SOFT)
+      OTHER_HLS(hart)->sswi = ptr_to_ddccap((uint32_t*)(uintptr_t)(scan->reg + index * 4));
+    value += 2;
+  }
+}
+
 static void clint_done(const struct fdt_scan_node *node, void *extra)
 {
   struct clint_scan *scan = (struct clint_scan *)extra;
   const uint32_t *value = scan->int_value;
   const uint32_t *end = value + scan->int_len/4;
 
+  if (scan->compat == SSWI_COMPAT) return sswi_done(scan);
   if (!scan->compat) return;
   assert (scan->reg != 0);
   assert (scan->int_value && scan->int_len % 16 == 0);
@@ -423,11 +849,8 @@ static void clint_done(const struct fdt_scan_node *node, void *extra)
     for (hart = 0; hart < MAX_HARTS; ++hart)
       if (hart_phandles[hart] == phandle)
         break;
-    if (hart < MAX_HARTS) {
-      hls_t *hls = OTHER_HLS(hart);
-      hls->ipi = ptr_to_ddccap((void*)((uintptr_t)scan->reg + index * 4));
-      hls->timecmp = ptr_to_ddccap((void*)((uintptr_t)scan->reg + 0x4000 + (index * 8)));
-    }
+    if (hart < MAX_HARTS)
+      clint_hart(hart, scan->reg, index);
     value += 4;
   }
 }
@@ -444,8 +867,11 @@ void query_clint(uintptr_t fdt)
   cb.extra = &scan;
 
   scan.done = 0;
-  fdt_scan(fdt, &cb);
+  fdt_scan_compatible(fdt, "riscv,clint0", &cb);
   assert (scan.done);
+
+  // Supervisor IPIs, if there is an ACLINT SSWI
+  fdt_scan_compatible(fdt, "riscv,aclint-sswi", &cb);
 }
 
 ///////////////////////////////////////////// PLIC SCAN /////////////////////////////////////////
@@ -471,14 +897,14 @@ static void plic_open(const struct fdt_scan_node *node, void *extra)
 static void plic_prop(const struct fdt_scan_prop *prop, void *extra)
 {
   struct plic_scan *scan = (struct plic_scan *)extra;
-  if (!strcmp(prop->name, "compatible") && fdt_string_list_index(prop, "riscv,plic0") >= 0) {
+  if (fdt_prop_is(prop, FDT_PROP_COMPATIBLE) && fdt_string_list_index(prop, "riscv,plic0") >= 0) {
     scan->compat = 1;
-  } else if (!strcmp(prop->name, "reg")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_REG)) {
     fdt_get_address(prop->node->parent, prop->value, &scan->reg);
-  } else if (!strcmp(prop->name, "interrupts-extended")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_INTERRUPTS_EXTENDED)) {
     scan->int_value = prop->value;
     scan->int_len = prop->len;
-  } else if (!strcmp(prop->name, "riscv,ndev")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_RISCV_NDEV)) {
     scan->ndev = bswap(prop->value[0]);
   }
 }
@@ -488,6 +914,20 @@ static void plic_prop(const struct fdt_scan_prop *prop, void *extra)
 #define ENABLE_BASE	0x2000
 #define ENABLE_SIZE	0x80
 
+static void plic_hart(int hart, uintptr_t reg, int index, uint32_t cpu_int)
+{
+  hls_t *hls = OTHER_HLS(hart);
+  if (cpu_int == IRQ_M_EXT) {
+    hls->plic_m_ie     = ptr_to_ddccap((uint32_t*)(reg + ENABLE_BASE + ENABLE_SIZE * index));
+    hls->plic_m_thresh = ptr_to_ddccap((uint32_t*) (reg + HART_BASE   + HART_SIZE   * index));
+  } else if (cpu_int == IRQ_S_EXT) {
+    hls->plic_s_ie     = ptr_to_ddccap((uint32_t*)(reg + ENABLE_BASE + ENABLE_SIZE * index));
+    hls->plic_s_thresh = ptr_to_ddccap((uint32_t*) (reg + HART_BASE   + HART_SIZE   * index));
+  } else {
+    printm("PLIC wired hart %d to wrong interrupt %d", hart, cpu_int);
+  }
+}
+
 static void plic_done(const struct fdt_scan_node *node, void *extra)
 {
   struct plic_scan *scan = (struct plic_scan *)extra;
@@ -511,18 +951,8 @@ static void plic_done(const struct fdt_scan_node *node, void *extra)
     for (hart = 0; hart < MAX_HARTS; ++hart)
       if (hart_phandles[hart] == phandle)
         break;
-    if (hart < MAX_HARTS) {
-      hls_t *hls = OTHER_HLS(hart);
-      if (cpu_int == IRQ_M_EXT) {
-        hls->plic_m_ie     = ptr_to_ddccap((uint32_t*)((uintptr_t)scan->reg + ENABLE_BASE + ENABLE_SIZE * index));
-        hls->plic_m_thresh = ptr_to_ddccap((uint32_t*) ((uintptr_t)scan->reg + HART_BASE   + HART_SIZE   * index));
-      } else if (cpu_int == IRQ_S_EXT) {
-        hls->plic_s_ie     = ptr_to_ddccap((uint32_t*)((uintptr_t)scan->reg + ENABLE_BASE + ENABLE_SIZE * index));
-        hls->plic_s_thresh = ptr_to_ddccap((uint32_t*) ((uintptr_t)scan->reg + HART_BASE   + HART_SIZE   * index));
-      } else {
-        printm("PLIC wired hart %d to wrong interrupt %d", hart, cpu_int);
-      }
-    }
+    if (hart < MAX_HARTS)
+      plic_hart(hart, scan->reg, index, cpu_int);
     value += 2;
   }
 #if 0
@@ -546,88 +976,7 @@ void query_plic(uintptr_t fdt)
   cb.extra = &scan;
 
   scan.done = 0;
-  fdt_scan(fdt, &cb);
-}
-
-static void plic_redact(const struct fdt_scan_node *node, void *extra)
-{
-  struct plic_scan *scan = (struct plic_scan *)extra;
-  uint32_t *value = scan->int_value;
-  uint32_t *end = value + scan->int_len/4;
-
-  if (!scan->compat) return;
-  scan->done = 1;
-
-  while (end - value > 0) {
-    if (bswap(value[1]) == IRQ_M_EXT) value[1] = bswap(-1);
-    value += 2;
-  }
-}
-
-void filter_plic(uintptr_t fdt)
-{
-  struct fdt_cb cb;
-  struct plic_scan scan;
-
-  memset(&cb, 0, sizeof(cb));
-  cb.open = plic_open;
-  cb.prop = plic_prop;
-  cb.done = plic_redact;
-  cb.extra = &scan;
-
-  scan.done = 0;
-  fdt_scan(fdt, &cb);
-}
-
-//////////////////////////////////////////// COMPAT SCAN ////////////////////////////////////////
-
-struct compat_scan
-{
-  const char *compat;
-  int depth;
-  int kill;
-};
-
-static void compat_open(const struct fdt_scan_node *node, void *extra)
-{
-  struct compat_scan *scan = (struct compat_scan *)extra;
-  ++scan->depth;
-}
-
-static void compat_prop(const struct fdt_scan_prop *prop, void *extra)
-{
-  struct compat_scan *scan = (struct compat_scan *)extra;
-  if (!strcmp(prop->name, "compatible") && fdt_string_list_index(prop, scan->compat) >= 0)
-    if (scan->depth < scan->kill)
-      scan->kill = scan->depth;
-}
-
-static int compat_close(const struct fdt_scan_node *node, void *extra)
-{
-  struct compat_scan *scan = (struct compat_scan *)extra;
-  if (scan->kill == scan->depth--) {
-    scan->kill = 999;
-    return -1;
-  } else {
-    return 0;
-  }
-}
-
-void filter_compat(uintptr_t fdt, const char *compat)
-{
-  struct fdt_cb cb;
-  struct compat_scan scan;
-
-  memset(&cb, 0, sizeof(cb));
-  cb.open = compat_open;
-  cb.prop = compat_prop;
-  cb.close = compat_close;
-  cb.extra = &scan;
-
-  scan.compat = compat;
-  scan.depth = 0;
-  scan.kill = 999;
-  fdt_scan(fdt, &cb);
+  fdt_scan_compatible(fdt, "riscv,plic0", &cb);
 }
 
 //////////////////////////////////////////// CHOSEN SCAN ////////////////////////////////////////
@@ -660,10 +1009,10 @@ static void chosen_prop(const struct fdt_scan_prop *prop, void *extra)
   struct chosen_scan *scan = (struct chosen_scan *)extra;
   uint64_t val;
   if (!scan->chosen) return;
-  if (!strcmp(prop->name, "riscv,kernel-start")) {
+  if (fdt_prop_is(prop, FDT_PROP_KERNEL_START)) {
     fdt_get_address(prop->node->parent, prop->value, &val);
     scan->kernel_start = (void*)(uintptr_t)val;
-  } else if (!strcmp(prop->name, "riscv,kernel-end")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_KERNEL_END)) {
     fdt_get_address(prop->node->parent, prop->value, &val);
     scan->kernel_end = (void*)(uintptr_t)val;
   }
@@ -682,91 +1031,353 @@ void query_chosen(uintptr_t fdt)
   memset(&chosen, 0, sizeof(chosen));
   cb.extra = &chosen;
 
-  fdt_scan(fdt, &cb);
+  fdt_scan_path(fdt, "/chosen", &cb);
   kernel_start = chosen.kernel_start;
   kernel_end = chosen.kernel_end;
 }
 
-//////////////////////////////////////////// HART FILTER ////////////////////////////////////////
+/////////////////////////////////////////// STATIC PLATFORM ////////////////////////////////////
 
-struct hart_filter {
-  int compat;
-  int hart;
-  char *status;
-  char *mmu_type;
-  long *disabled_hart_mask;
-};
+#ifdef PK_STATIC_PLATFORM
+void query_platform_console()
+{
+#if defined(PLATFORM_UART_BASE)
+  uart_init(PLATFORM_UART_BASE);
+# ifdef PLATFORM_UART_IRQ
+  uart_irq = PLATFORM_UART_IRQ;
+# endif
+#elif defined(PLATFORM_UART16550_BASE)
+# ifndef PLATFORM_UART16550_CLOCK
+#  define PLATFORM_UART16550_CLOCK 0
+# endif
+# ifndef PLATFORM_UART16550_BAUD
+#  define PLATFORM_UART16550_BAUD 0
+# endif
+  uart16550_init(PLATFORM_UART16550_BASE, PLATFORM_UART16550_REG_SHIFT,
+                 PLATFORM_UART16550_CLOCK, PLATFORM_UART16550_BAUD);
+# ifdef PLATFORM_UART16550_IRQ
+  uart16550_irq = PLATFORM_UART16550_IRQ;
+# endif
+#elif defined(PLATFORM_HTIF)
+  htif = 1;
+#endif
+}
 
-static void hart_filter_open(const struct fdt_scan_node *node, void *extra)
+void query_platform()
 {
-  struct hart_filter *filter = (struct hart_filter *)extra;
-  filter->status = NULL;
-  filter->mmu_type = NULL;
-  filter->compat = 0;
-  filter->hart = -1;
+  static const int harts[] = PLATFORM_HARTS;
+  static const int clint_index[] = PLATFORM_CLINT_INDEX;
+  static const int plic_m_context[] = PLATFORM_PLIC_M_CONTEXT;
+  static const int plic_s_context[] = PLATFORM_PLIC_S_CONTEXT;
+  static const int sstc[] = PLATFORM_SSTC;
+#ifdef PLATFORM_SSWI_BASE
+  static const int sswi_index[] = PLATFORM_SSWI_INDEX;
+#endif
+
+#ifdef PLATFORM_FINISHER_BASE
+  finisher = ptr_to_ddccap((uint32_t*)PLATFORM_FINISHER_BASE);
+#endif
+  mem_size = PLATFORM_MEM_SIZE;
+  mtime = ptr_to_ddccap((void*)(PLATFORM_CLINT_BASE + 0xbff8));
+#ifdef PLATFORM_PLIC_BASE
+  plic_priorities = ptr_to_ddccap((uint32_t*)PLATFORM_PLIC_BASE);
+  plic_ndevs = PLATFORM_PLIC_NDEV;
+#endif
+
+  for (int i = 0; i < PLATFORM_HART_COUNT; ++i) {
+    int hart = harts[i];
+    if (hart >= MAX_HARTS)
+      continue;
+    hart_mask_set(&hart_mask, hart);
+    hls_init(hart)->sstc = sstc[i];
+    if (clint_index[i] >= 0)
+      clint_hart(hart, PLATFORM_CLINT_BASE, clint_index[i]);
+#ifdef PLATFORM_SSWI_BASE
+    if (sswi_index[i] >= 0)
+      OTHER_HLS(hart)->sswi = ptr_to_ddccap((uint32_t*)(PLATFORM_SSWI_BASE + sswi_index[i] * 4));
+#endif
+#ifdef PLATFORM_PLIC_BASE
+    if (plic_m_context[i] >= 0)
+      plic_hart(hart, PLATFORM_PLIC_BASE, plic_m_context[i], IRQ_M_EXT);
+    if (plic_s_context[i] >= 0)
+      plic_hart(hart, PLATFORM_PLIC_BASE, plic_s_context[i], IRQ_S_EXT);
+#endif
+  }
+
+  // The current hart should have been described
+  assert (hart_mask_test(&hart_mask, read_csr(mhartid)));
 }
+#endif
+
+//////////////////////////////////////////// FILTER /////////////////////////////////////////////
 
-static void hart_filter_prop(const struct fdt_scan_prop *prop, void *extra)
+#define FDT_FILTER_MAX_DEPTH 32
+
+// What the properties of a node (which all precede its children) say about it
+struct fdt_filter_node {
+  bool drop;
+  bool cpu;
+  bool plic;
+  int address_cells;
+  int size_cells;
+  const char *status;
+  const char *mmu_type;
+  const uint32_t *reg;
+};
+
+static void fdt_filter_inspect(uint32_t *lex, const char *strings,
+                               const struct fdt_filter *filter, struct fdt_filter_node *node)
 {
-  struct hart_filter *filter = (struct hart_filter *)extra;
-  if (!strcmp(prop->name, "device_type") && !strcmp((const char*)prop->value, "cpu")) {
-    filter->compat = 1;
-  } else if (!strcmp(prop->name, "reg")) {
-    uint64_t reg;
-    fdt_get_address(prop->node->parent, prop->value, &reg);
-    filter->hart = reg;
-  } else if (!strcmp(prop->name, "status")) {
-    filter->status = (char*)prop->value;
-  } else if (!strcmp(prop->name, "mmu-type")) {
-    filter->mmu_type = (char*)prop->value;
+  struct fdt_scan_prop prop;
+
+  memset(node, 0, sizeof(*node));
+  node->address_cells = 2;
+  node->size_cells = 1;
+
+  while (1) {
+    switch (bswap(lex[0])) {
+      case FDT_NOP: {
+        lex += 1;
+        break;
+      }
+      case FDT_PROP: {
+        prop.nameoff = bswap(lex[2]);
+        prop.name  = strings + prop.nameoff;
+        prop.len   = bswap(lex[1]);
+        prop.value = lex + 3;
+        if (fdt_prop_is(&prop, FDT_PROP_COMPATIBLE)) {
+          for (const char **compat = filter->drop_compat; compat && *compat; ++compat)
+            node->drop |= fdt_string_list_index(&prop, *compat) >= 0;
+          node->plic = fdt_string_list_index(&prop, "riscv,plic0") >= 0;
+        } else if (fdt_prop_is(&prop, FDT_PROP_DEVICE_TYPE)) {
+          node->cpu = !strcmp((const char*)prop.value, "cpu");
+        } else if (fdt_prop_is(&prop, FDT_PROP_ADDRESS_CELLS)) {
+          node->address_cells = bswap(prop.value[0]);
+        } else if (fdt_prop_is(&prop, FDT_PROP_SIZE_CELLS)) {
+          node->size_cells = bswap(prop.value[0]);
+        } else if (fdt_prop_is(&prop, FDT_PROP_STATUS)) {
+          node->status = (const char*)prop.value;
+        } else if (fdt_prop_is(&prop, FDT_PROP_MMU_TYPE)) {
+          node->mmu_type = (const char*)prop.value;
+        } else if (fdt_prop_is(&prop, FDT_PROP_REG)) {
+          node->reg = prop.value;
+        }
+        lex += 3 + (prop.len+3)/4;
+        break;
+      }
+      default:
+        return;
+    }
   }
 }
 
-static bool hart_filter_mask(const struct hart_filter *filter)
+static bool hart_filter_mask(const struct fdt_filter_node *node)
 {
-  if (filter->mmu_type == NULL) return true;
-  if (strcmp(filter->status, "okay")) return true;
+  if (node->mmu_type == NULL) return true;
+  if (strcmp(node->status, "okay")) return true;
 #if __riscv_xlen == 32
-  if (!strcmp(filter->mmu_type, "riscv,sv32")) return false;
+  if (!strcmp(node->mmu_type, "riscv,sv32")) return false;
 #else
-  if (!strcmp(filter->mmu_type, "riscv,sv39")) return false;
-  if (!strcmp(filter->mmu_type, "riscv,sv48")) return false;
+  if (!strcmp(node->mmu_type, "riscv,sv39")) return false;
+  if (!strcmp(node->mmu_type, "riscv,sv48")) return false;
 #endif
   printm("hart_filter_mask saw unknown hart type: status=\"%s\", mmu_type=\"%s\"\n",
-         filter->status, filter->mmu_type);
+         node->status, node->mmu_type);
   return true;
 }
 
-static void hart_filter_done(const struct fdt_scan_node *node, void *extra)
+// The token just past the end of the node starting at lex
+static uint32_t *fdt_skip_node(uint32_t *lex)
 {
-  struct hart_filter *filter = (struct hart_filter *)extra;
+  int depth = 0;
+  do {
+    switch (bswap(lex[0])) {
+      case FDT_BEGIN_NODE: ++depth; lex += 2 + strlen((const char *)(lex+1))/4; break;
+      case FDT_END_NODE:   --depth; lex += 1; break;
+      case FDT_PROP:       lex += 3 + (bswap(lex[1])+3)/4; break;
+      case FDT_NOP:        lex += 1; break;
+      default:             return lex; // FDT_END
+    }
+  } while (depth > 0);
+  return lex;
+}
 
-  if (!filter->compat) return;
-  assert (filter->status);
-  assert (filter->hart >= 0);
+static uint32_t *fdt_emit_prop(uint32_t *out, uint32_t nameoff, const void *value, uint32_t len)
+{
+  out[2 + (len+3)/4] = 0; // zero the padding
+  out[0] = bswap(FDT_PROP);
+  out[1] = bswap(len);
+  out[2] = bswap(nameoff);
+  memcpy(out + 3, value, len);
+  return out + 3 + (len+3)/4;
+}
 
-  if (hart_filter_mask(filter)) {
-    strcpy(filter->status, "masked");
-    uint32_t *len = (uint32_t*)filter->status;
-    len[-2] = bswap(strlen("masked")+1);
-    *filter->disabled_hart_mask |= (1 << filter->hart);
+// The extra /chosen properties, named by strings appended after nameoff
+static uint32_t *fdt_filter_chosen(uint32_t *out, const struct fdt_filter *filter, uint32_t nameoff)
+{
+  for (int i = 0; i < filter->chosen_count; i++) {
+    struct fdt_filter_prop *prop = &filter->chosen[i];
+    prop->out = out + 3;
+    out = fdt_emit_prop(out, nameoff, prop->value, prop->len);
+    nameoff += strlen(prop->name) + 1;
   }
+  return out;
 }
 
-void filter_harts(uintptr_t fdt, long *disabled_hart_mask)
+static bool fdt_filter_chosen_has(const struct fdt_filter *filter, const char *name)
 {
-  struct fdt_cb cb;
-  struct hart_filter filter;
+  for (int i = 0; i < filter->chosen_count; i++)
+    if (!strcmp(filter->chosen[i].name, name)) return true;
+  return false;
+}
 
-  memset(&cb, 0, sizeof(cb));
-  cb.open = hart_filter_open;
-  cb.prop = hart_filter_prop;
-  cb.done = hart_filter_done;
-  cb.extra = &filter;
+uint32_t fdt_filter(uintptr_t src, uintptr_t dest, const struct fdt_filter *filter)
+{
+  struct fdt_header *in = (struct fdt_header *)src;
+  struct fdt_header *out = (struct fdt_header *)dest;
+  int address_cells[FDT_FILTER_MAX_DEPTH];
+  int depth = 0;
+  struct fdt_filter_node node;
+  bool masked = false;
+  int chosen_depth = 0; // while the /chosen properties are being copied
+  bool chosen_seen = false;
+
+  for (int i = 0; i < filter->chosen_count; i++)
+    filter->chosen[i].out = NULL;
 
-  filter.disabled_hart_mask = disabled_hart_mask;
-  *disabled_hart_mask = 0;
-  fdt_scan(fdt, &cb);
+  // Only process FDT that we understand
+  if (bswap(in->magic) != FDT_MAGIC ||
+      bswap(in->last_comp_version) > FDT_VERSION) return 0;
+
+  const char *strings = (const char *)(src + bswap(in->off_dt_strings));
+  uint32_t size_dt_strings = bswap(in->size_dt_strings);
+  uint32_t *lex = (uint32_t *)(src + bswap(in->off_dt_struct));
+
+  fdt_scan_indexed = fdt_index_matches(src);
+  if (filter->disabled_hart_mask)
+    memset(filter->disabled_hart_mask, 0, sizeof(*filter->disabled_hart_mask));
+
+  // Memory reservations, up to and including the empty terminator
+  const uint64_t *rsv = (const uint64_t *)(src + bswap(in->off_mem_rsvmap));
+  uint64_t *rsv_out = (uint64_t *)(dest + sizeof(struct fdt_header));
+  do {
+    rsv_out[0] = rsv[0];
+    rsv_out[1] = rsv[1];
+    rsv += 2;
+    rsv_out += 2;
+  } while (rsv[-2] || rsv[-1]);
+
+  uint32_t *struct_out = (uint32_t *)rsv_out;
+  uint32_t *w = struct_out;
+
+  while (1) {
+    switch (bswap(lex[0])) {
+      case FDT_NOP: {
+        lex += 1;
+        break;
+      }
+      case FDT_BEGIN_NODE: {
+        uint32_t *props = lex + 2 + strlen((const char *)(lex+1))/4;
+        if (chosen_depth && depth == chosen_depth) {
+          w = fdt_filter_chosen(w, filter, size_dt_strings);
+          chosen_depth = 0;
+        }
+
+        fdt_filter_inspect(props, strings, filter, &node);
+        if (node.drop) {
+          lex = fdt_skip_node(lex);
+          break;
+        }
+
+        masked = false;
+        if (node.cpu && filter->disabled_hart_mask) {
+          assert (node.status && node.reg && depth > 0);
+          uint64_t hart = 0;
+          for (int cells = address_cells[depth-1]; cells > 0; --cells)
+            hart = (hart << 32) + bswap(node.reg[address_cells[depth-1] - cells]);
+          if ((masked = hart_filter_mask(&node)) && hart < MAX_HARTS)
+            hart_mask_set(filter->disabled_hart_mask, hart);
+        }
+
+        assert (depth < FDT_FILTER_MAX_DEPTH);
+        if (depth == 1 && !strcmp((const char *)(lex+1), "chosen")) {
+          chosen_depth = depth + 1;
+          chosen_seen = true;
+        }
+        address_cells[depth++] = node.address_cells;
+        while (lex != props) *w++ = *lex++;
+        break;
+      }
+      case FDT_PROP: {
+        struct fdt_scan_prop prop;
+        prop.nameoff = bswap(lex[2]);
+        prop.name  = strings + prop.nameoff;
+        prop.len   = bswap(lex[1]);
+        prop.value = lex + 3;
+        lex += 3 + (prop.len+3)/4;
+
+        // Properties we add to /chosen replace those passed in
+        if (chosen_depth && depth == chosen_depth && fdt_filter_chosen_has(filter, prop.name))
+          break;
+
+        if (masked && fdt_prop_is(&prop, FDT_PROP_STATUS)) {
+          w = fdt_emit_prop(w, prop.nameoff, "masked", strlen("masked")+1);
+        } else if (node.plic && filter->redact_plic && fdt_prop_is(&prop, FDT_PROP_INTERRUPTS_EXTENDED)) {
+          uint32_t *value = w + 3;
+          w = fdt_emit_prop(w, prop.nameoff, prop.value, prop.len);
+          for (; w - value > 1; value += 2)
+            if (bswap(value[1]) == IRQ_M_EXT) value[1] = bswap(-1);
+        } else {
+          w = fdt_emit_prop(w, prop.nameoff, prop.value, prop.len);
+        }
+        break;
+      }
+      case FDT_END_NODE: {
+        if (chosen_depth && depth == chosen_depth) {
+          w = fdt_filter_chosen(w, filter, size_dt_strings);
+          chosen_depth = 0;
+        } else if (depth == 1 && !chosen_seen && filter->chosen_count) {
+          // The root is closing without a /chosen; add one
+          *w++ = bswap(FDT_BEGIN_NODE);
+          w[0] = w[1] = 0;
+          memcpy(w, "chosen", sizeof("chosen"));
+          w += 2;
+          w = fdt_filter_chosen(w, filter, size_dt_strings);
+          *w++ = bswap(FDT_END_NODE);
+        }
+        --depth;
+        // Properties of the parent cannot follow its children
+        node.plic = false;
+        masked = false;
+        *w++ = *lex++;
+        break;
+      }
+      default: { // FDT_END
+        *w++ = bswap(FDT_END);
+        uint32_t size_dt_struct = (uintptr_t)w - (uintptr_t)struct_out;
+        memcpy(w, strings, size_dt_strings);
+        char *names = (char *)w + size_dt_strings;
+        for (int i = 0; i < filter->chosen_count; i++) {
+          size_t n = strlen(filter->chosen[i].name) + 1;
+          memcpy(names, filter->chosen[i].name, n);
+          names += n;
+        }
+        size_dt_strings = names - (char *)w;
+
+        out->magic             = bswap(FDT_MAGIC);
+        out->version           = bswap(FDT_VERSION);
+        out->last_comp_version = bswap(16);
+        out->boot_cpuid_phys   = in->boot_cpuid_phys;
+        out->off_mem_rsvmap    = bswap(sizeof(struct fdt_header));
+        out->off_dt_struct     = bswap((uintptr_t)struct_out - dest);
+        out->size_dt_struct    = bswap(size_dt_struct);
+        out->off_dt_strings    = bswap((uintptr_t)w - dest);
+        out->size_dt_strings   = bswap(size_dt_strings);
+        out->totalsize         = bswap((uintptr_t)w - dest + size_dt_strings);
+        return bswap(out->totalsize);
+      }
+    }
+  }
 }
 
 //////////////////////////////////////////// PRINT //////////////////////////////////////////////
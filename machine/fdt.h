@@ -3,6 +3,8 @@
 #ifndef FDT_H
 #define FDT_H
 
+#include "mtrap.h"
+
 #define FDT_MAGIC	0xd00dfeed
 #define FDT_VERSION	17
 
@@ -35,6 +37,7 @@ struct fdt_scan_node {
 struct fdt_scan_prop {
   const struct fdt_scan_node *node;
   const char *name;
+  uint32_t nameoff; // offset of name in the strings block
   uint32_t *value;
   int len; // in bytes of value
 };
@@ -47,14 +50,71 @@ struct fdt_cb {
   void *extra;
 };
 
+// Property names that can be matched by string-table offset once indexed
+#define FDT_PROP_NAMES(X) \
+  X(ADDRESS_CELLS,        "#address-cells") \
+  X(SIZE_CELLS,           "#size-cells") \
+  X(INTERRUPT_CELLS,      "#interrupt-cells") \
+  X(COMPATIBLE,           "compatible") \
+  X(DEVICE_TYPE,          "device_type") \
+  X(REG,                  "reg") \
+  X(STATUS,               "status") \
+  X(PHANDLE,              "phandle") \
+  X(LINUX_PHANDLE,        "linux,phandle") \
+  X(INTERRUPT_CONTROLLER, "interrupt-controller") \
+  X(INTERRUPTS,           "interrupts") \
+  X(INTERRUPTS_EXTENDED,  "interrupts-extended") \
+  X(MMU_TYPE,             "mmu-type") \
+  X(RISCV_ISA,            "riscv,isa") \
+  X(RISCV_ISA_EXTENSIONS, "riscv,isa-extensions") \
+  X(CLOCKS,               "clocks") \
+  X(CLOCK_FREQUENCY,      "clock-frequency") \
+  X(CURRENT_SPEED,        "current-speed") \
+  X(REG_SHIFT,            "reg-shift") \
+  X(REG_OFFSET,           "reg-offset") \
+  X(RISCV_NDEV,           "riscv,ndev") \
+  X(KERNEL_START,         "riscv,kernel-start") \
+  X(KERNEL_END,           "riscv,kernel-end") \
+  X(PMU_EVENTS,           "riscv,event-to-mhpmevent") \
+  X(PMU_COUNTERS,         "riscv,event-to-mhpmcounters") \
+  X(PMU_RAW_COUNTERS,     "riscv,raw-event-to-mhpmcounters") \
+  X(SOC_VERSION,          "sri-cambridge,version")
+
+enum fdt_prop_id {
+#define FDT_PROP_ENUM(id, name) FDT_PROP_##id,
+  FDT_PROP_NAMES(FDT_PROP_ENUM)
+#undef FDT_PROP_ENUM
+  FDT_PROP_COUNT
+};
+
 // Scan the contents of FDT
 void fdt_scan(uintptr_t fdt, const struct fdt_cb *cb);
 uint32_t fdt_size(uintptr_t fdt);
 
+// Build the node index used by the lookups below; call once the FDT is final.
+// Copies of the indexed FDT (same layout) can be looked up with the same index.
+void fdt_index(uintptr_t fdt);
+
+// Indexed lookups; nodes are small integers, -1 if missing or not indexed
+int fdt_node_by_path(uintptr_t fdt, const char *path);
+int fdt_node_by_phandle(uintptr_t fdt, uint32_t phandle);
+int fdt_node_by_compatible(uintptr_t fdt, const char *compat, int prev);
+const uint32_t *fdt_node_prop(uintptr_t fdt, int node, enum fdt_prop_id id, int *len);
+
+// Scan only the matching nodes (and their children); falls back to fdt_scan without an index
+void fdt_scan_node(uintptr_t fdt, int node, const struct fdt_cb *cb);
+void fdt_scan_path(uintptr_t fdt, const char *path, const struct fdt_cb *cb);
+void fdt_scan_compatible(uintptr_t fdt, const char *compat, const struct fdt_cb *cb);
+void fdt_scan_device_type(uintptr_t fdt, const char *type, const struct fdt_cb *cb);
+
+// Compare a property name, by string-table offset when the FDT is indexed
+int fdt_prop_is(const struct fdt_scan_prop *prop, enum fdt_prop_id id);
+
 // Extract fields
 const uint32_t *fdt_get_address(const struct fdt_scan_node *node, const uint32_t *base, uint64_t *value);
 const uint32_t *fdt_get_size(const struct fdt_scan_node *node, const uint32_t *base, uint64_t *value);
 uint32_t fdt_get_value(const struct fdt_scan_prop *prop, uint32_t index);
+uint32_t fdt_cell(const uint32_t *value);
 int fdt_string_list_index(const struct fdt_scan_prop *prop, const char *str); // -1 if not found
 
 // Setup memory+clint+plic
@@ -65,13 +125,33 @@ void query_plic(uintptr_t fdt);
 void query_clint(uintptr_t fdt);
 void query_chosen(uintptr_t fdt);
 
+#ifdef PK_STATIC_PLATFORM
+// Setup the same from the build-time platform profile instead
+void query_platform_console();
+void query_platform();
+#endif
+
 // Remove information from FDT
-void filter_harts(uintptr_t fdt, long *disabled_hart_mask);
-void filter_plic(uintptr_t fdt);
-void filter_compat(uintptr_t fdt, const char *compat);
+struct fdt_filter_prop {
+  const char *name;
+  const void *value;
+  uint32_t len;
+  void *out;                 // set to where the value was copied in dest, NULL if it wasn't
+};
+
+struct fdt_filter {
+  const char **drop_compat;  // NULL-terminated; matching nodes are dropped with their children
+  hart_mask_t *disabled_hart_mask; // if set, unusable harts are marked "masked" and recorded here
+  int redact_plic;           // hide the M-mode PLIC contexts
+  struct fdt_filter_prop *chosen; // set in /chosen, replacing any of the same name
+  int chosen_count;
+};
+
+// Copy src to dest in one pass, applying the filter and dropping NOPs; returns the new size
+uint32_t fdt_filter(uintptr_t src, uintptr_t dest, const struct fdt_filter *filter);
 
 // The hartids of available harts
-extern uint64_t hart_mask;
+extern hart_mask_t hart_mask;
 
 // Optional FDT preloaded external payload
 extern void* kernel_start;
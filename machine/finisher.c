@@ -32,9 +32,9 @@ static void finisher_open(const struct fdt_scan_node *node, void *extra)
 static void finisher_prop(const struct fdt_scan_prop *prop, void *extra)
 {
   struct finisher_scan *scan = (struct finisher_scan *)extra;
-  if (!strcmp(prop->name, "compatible") && fdt_string_list_index(prop, "sifive,test0") >= 0) {
+  if (fdt_prop_is(prop, FDT_PROP_COMPATIBLE) && fdt_string_list_index(prop, "sifive,test0") >= 0) {
     scan->compat = 1;
-  } else if (!strcmp(prop->name, "reg")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_REG)) {
     fdt_get_address(prop->node->parent, prop->value, &scan->reg);
   }
 }
@@ -57,5 +57,5 @@ void query_finisher(uintptr_t fdt)
   cb.done = finisher_done;
   cb.extra = &scan;
 
-  fdt_scan(fdt, &cb);
+  fdt_scan_compatible(fdt, "sifive,test0", &cb);
 }
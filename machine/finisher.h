@@ -9,6 +9,8 @@
 #define FINISHER_FAIL		0x3333
 #define FINISHER_PASS		0x5555
 
+extern volatile uint32_t* finisher;
+
 void finisher_exit(uint16_t code);
 void query_finisher(uintptr_t fdt);
 
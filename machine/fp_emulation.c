@@ -2,8 +2,7 @@
 
 #include "fp_emulation.h"
 #include "unprivileged_memory.h"
-#include "softfloat.h"
-#include "internals.h"
+#include "fp_fastpath.h"
 #include "config.h"
 
 #ifdef PK_ENABLE_FP_EMULATION
@@ -72,11 +71,17 @@ void emulate_any_fadd(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc, uintptr
   if (GET_PRECISION(insn) == PRECISION_S) {
     uint32_t rs1 = GET_F32_RS1(insn, regs);
     uint32_t rs2 = GET_F32_RS2(insn, regs) ^ neg_b;
-    SET_F32_RD(insn, regs, f32_add(f32(rs1), f32(rs2)).v);
+    uint32_t rd;
+    if (!f32_add_fast(rs1, rs2, &rd))
+      rd = f32_add(f32(rs1), f32(rs2)).v;
+    SET_F32_RD(insn, regs, rd);
   } else if (GET_PRECISION(insn) == PRECISION_D) {
     uint64_t rs1 = GET_F64_RS1(insn, regs);
     uint64_t rs2 = GET_F64_RS2(insn, regs) ^ ((uint64_t)neg_b << 32);
-    SET_F64_RD(insn, regs, f64_add(f64(rs1), f64(rs2)).v);
+    uint64_t rd;
+    if (!f64_add_fast(rs1, rs2, &rd))
+      rd = f64_add(f64(rs1), f64(rs2)).v;
+    SET_F64_RD(insn, regs, rd);
   } else {
     return truly_illegal_insn(regs, mcause, mepc, mstatus, insn);
   }
@@ -97,11 +102,17 @@ DECLARE_EMULATION_FUNC(emulate_fmul)
   if (GET_PRECISION(insn) == PRECISION_S) {
     uint32_t rs1 = GET_F32_RS1(insn, regs);
     uint32_t rs2 = GET_F32_RS2(insn, regs);
-    SET_F32_RD(insn, regs, f32_mul(f32(rs1), f32(rs2)).v);
+    uint32_t rd;
+    if (!f32_mul_fast(rs1, rs2, &rd))
+      rd = f32_mul(f32(rs1), f32(rs2)).v;
+    SET_F32_RD(insn, regs, rd);
   } else if (GET_PRECISION(insn) == PRECISION_D) {
     uint64_t rs1 = GET_F64_RS1(insn, regs);
     uint64_t rs2 = GET_F64_RS2(insn, regs);
-    SET_F64_RD(insn, regs, f64_mul(f64(rs1), f64(rs2)).v);
+    uint64_t rd;
+    if (!f64_mul_fast(rs1, rs2, &rd))
+      rd = f64_mul(f64(rs1), f64(rs2)).v;
+    SET_F64_RD(insn, regs, rd);
   } else {
     return truly_illegal_insn(regs, mcause, mepc, mstatus, insn);
   }
@@ -0,0 +1,216 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_FP_FASTPATH_H
+#define _RISCV_FP_FASTPATH_H
+
+// platform.h first, for internals.h to take the little-endian word order
+#include "platform.h"
+#include "softfloat.h"
+#include "internals.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fast paths for normal, finite operands rounded to nearest-even.  They
+// follow softfloat's own add, sub and mul step for step, but return 0
+// instead of handling zeros, subnormals, infinities, NaNs, any other
+// rounding mode, or a result that is not normal.  The caller then falls
+// back on softfloat, which gets the same result the long way.
+
+#define F32_NORMAL(exp) ((unsigned)(exp) - 1 < 0xFE)
+#define F64_NORMAL(exp) ((unsigned)(exp) - 1 < 0x7FE)
+
+static inline int f32_round_pack_fast(bool sign, int_fast16_t exp, uint_fast32_t sig, uint32_t* z)
+{
+  if (0xFD <= (unsigned int)exp)
+    return 0;
+
+  uint_fast8_t roundBits = sig & 0x7F;
+  sig = (sig + 0x40) >> 7;
+  if (roundBits)
+    softfloat_raiseFlags(softfloat_flag_inexact);
+  sig &= ~(uint_fast32_t)(!(roundBits ^ 0x40) & 1);
+  *z = packToF32UI(sign, exp, sig);
+  return 1;
+}
+
+static inline int f64_round_pack_fast(bool sign, int_fast16_t exp, uint_fast64_t sig, uint64_t* z)
+{
+  if (0x7FD <= (uint16_t)exp)
+    return 0;
+
+  uint_fast16_t roundBits = sig & 0x3FF;
+  sig = (sig + 0x200) >> 10;
+  if (roundBits)
+    softfloat_raiseFlags(softfloat_flag_inexact);
+  sig &= ~(uint_fast64_t)(!(roundBits ^ 0x200) & 1);
+  *z = packToF64UI(sign, exp, sig);
+  return 1;
+}
+
+static inline int f32_add_fast(uint32_t uiA, uint32_t uiB, uint32_t* z)
+{
+  int_fast16_t expA = expF32UI(uiA), expB = expF32UI(uiB), expZ;
+  uint_fast32_t sigA = fracF32UI(uiA), sigB = fracF32UI(uiB), sigZ;
+  bool signZ = signF32UI(uiA);
+
+  if (softfloat_roundingMode != softfloat_round_near_even || !F32_NORMAL(expA) || !F32_NORMAL(expB))
+    return 0;
+
+  if (expA < expB) {
+    int_fast16_t exp = expA; expA = expB; expB = exp;
+    uint_fast32_t sig = sigA; sigA = sigB; sigB = sig;
+    signZ ^= signF32UI(uiA) != signF32UI(uiB);
+  }
+  int_fast16_t expDiff = expA - expB;
+
+  if (signF32UI(uiA) == signF32UI(uiB)) {
+    expZ = expA;
+    if (!expDiff) {
+      sigZ = (0x01000000 + sigA + sigB) << 6;
+    } else {
+      sigB = softfloat_shiftRightJam32((sigB << 6) + 0x20000000, expDiff);
+      sigZ = 0x20000000 + (sigA << 6) + sigB;
+      if (sigZ < 0x40000000) {
+        --expZ;
+        sigZ <<= 1;
+      }
+    }
+    return f32_round_pack_fast(signZ, expZ, sigZ, z);
+  }
+
+  if (!expDiff) {
+    int_fast32_t sigDiff = sigA - sigB;
+    if (!sigDiff) {
+      *z = packToF32UI(0, 0, 0);
+      return 1;
+    }
+    if (sigDiff < 0) {
+      signZ = !signZ;
+      sigDiff = -sigDiff;
+    }
+    int_fast8_t shiftDist = softfloat_countLeadingZeros32(sigDiff) - 8;
+    expZ = expA - 1 - shiftDist;
+    if (expZ < 0)
+      return 0;
+    *z = packToF32UI(signZ, expZ, sigDiff << shiftDist);
+    return 1;
+  }
+
+  sigB = softfloat_shiftRightJam32((sigB << 7) + 0x40000000, expDiff);
+  sigZ = ((sigA << 7) | 0x40000000) - sigB;
+  int_fast8_t shiftDist = softfloat_countLeadingZeros32(sigZ) - 1;
+  expZ = expA - 1 - shiftDist;
+  if (7 <= shiftDist && (unsigned int)expZ < 0xFD) {
+    *z = packToF32UI(signZ, expZ, sigZ << (shiftDist - 7));
+    return 1;
+  }
+  return f32_round_pack_fast(signZ, expZ, sigZ << shiftDist, z);
+}
+
+static inline int f64_add_fast(uint64_t uiA, uint64_t uiB, uint64_t* z)
+{
+  int_fast16_t expA = expF64UI(uiA), expB = expF64UI(uiB), expZ;
+  uint_fast64_t sigA = fracF64UI(uiA), sigB = fracF64UI(uiB), sigZ;
+  bool signZ = signF64UI(uiA);
+
+  if (softfloat_roundingMode != softfloat_round_near_even || !F64_NORMAL(expA) || !F64_NORMAL(expB))
+    return 0;
+
+  if (expA < expB) {
+    int_fast16_t exp = expA; expA = expB; expB = exp;
+    uint_fast64_t sig = sigA; sigA = sigB; sigB = sig;
+    signZ ^= signF64UI(uiA) != signF64UI(uiB);
+  }
+  int_fast16_t expDiff = expA - expB;
+
+  if (signF64UI(uiA) == signF64UI(uiB)) {
+    expZ = expA;
+    if (!expDiff) {
+      sigZ = (UINT64_C(0x0020000000000000) + sigA + sigB) << 9;
+    } else {
+      sigB = softfloat_shiftRightJam64((sigB << 9) + UINT64_C(0x2000000000000000), expDiff);
+      sigZ = UINT64_C(0x2000000000000000) + (sigA << 9) + sigB;
+      if (sigZ < UINT64_C(0x4000000000000000)) {
+        --expZ;
+        sigZ <<= 1;
+      }
+    }
+    return f64_round_pack_fast(signZ, expZ, sigZ, z);
+  }
+
+  if (!expDiff) {
+    int_fast64_t sigDiff = sigA - sigB;
+    if (!sigDiff) {
+      *z = packToF64UI(0, 0, 0);
+      return 1;
+    }
+    if (sigDiff < 0) {
+      signZ = !signZ;
+      sigDiff = -sigDiff;
+    }
+    int_fast8_t shiftDist = softfloat_countLeadingZeros64(sigDiff) - 11;
+    expZ = expA - 1 - shiftDist;
+    if (expZ < 0)
+      return 0;
+    *z = packToF64UI(signZ, expZ, sigDiff << shiftDist);
+    return 1;
+  }
+
+  sigB = softfloat_shiftRightJam64((sigB << 10) + UINT64_C(0x4000000000000000), expDiff);
+  sigZ = ((sigA << 10) | UINT64_C(0x4000000000000000)) - sigB;
+  int_fast8_t shiftDist = softfloat_countLeadingZeros64(sigZ) - 1;
+  expZ = expA - 1 - shiftDist;
+  if (10 <= shiftDist && (unsigned int)expZ < 0x7FD) {
+    *z = packToF64UI(signZ, expZ, sigZ << (shiftDist - 10));
+    return 1;
+  }
+  return f64_round_pack_fast(signZ, expZ, sigZ << shiftDist, z);
+}
+
+static inline int f32_mul_fast(uint32_t uiA, uint32_t uiB, uint32_t* z)
+{
+  int_fast16_t expA = expF32UI(uiA), expB = expF32UI(uiB);
+
+  if (softfloat_roundingMode != softfloat_round_near_even || !F32_NORMAL(expA) || !F32_NORMAL(expB))
+    return 0;
+
+  int_fast16_t expZ = expA + expB - 0x7F;
+  uint_fast32_t sigA = (fracF32UI(uiA) | 0x00800000) << 7;
+  uint_fast32_t sigB = (fracF32UI(uiB) | 0x00800000) << 8;
+  uint_fast32_t sigZ = softfloat_shortShiftRightJam64((uint_fast64_t)sigA * sigB, 32);
+  if (sigZ < 0x40000000) {
+    --expZ;
+    sigZ <<= 1;
+  }
+  return f32_round_pack_fast(signF32UI(uiA) ^ signF32UI(uiB), expZ, sigZ, z);
+}
+
+static inline int f64_mul_fast(uint64_t uiA, uint64_t uiB, uint64_t* z)
+{
+  int_fast16_t expA = expF64UI(uiA), expB = expF64UI(uiB);
+
+  if (softfloat_roundingMode != softfloat_round_near_even || !F64_NORMAL(expA) || !F64_NORMAL(expB))
+    return 0;
+
+  int_fast16_t expZ = expA + expB - 0x3FF;
+  uint_fast64_t sigA = (fracF64UI(uiA) | UINT64_C(0x0010000000000000)) << 10;
+  uint_fast64_t sigB = (fracF64UI(uiB) | UINT64_C(0x0010000000000000)) << 11;
+  uint_fast64_t sigZ;
+#if __riscv_xlen == 64 && defined(__riscv_muldiv)
+  unsigned __int128 prod = (unsigned __int128)sigA * sigB;
+  sigZ = (uint64_t)(prod >> 64) | ((uint64_t)prod != 0);
+#else
+  uint32_t sig128Z[4];
+  softfloat_mul64To128M(sigA, sigB, sig128Z);
+  sigZ = (uint64_t)sig128Z[indexWord(4, 3)] << 32 | sig128Z[indexWord(4, 2)];
+  if (sig128Z[indexWord(4, 1)] || sig128Z[indexWord(4, 0)])
+    sigZ |= 1;
+#endif
+  if (sigZ < UINT64_C(0x4000000000000000)) {
+    --expZ;
+    sigZ <<= 1;
+  }
+  return f64_round_pack_fast(signF64UI(uiA) ^ signF64UI(uiB), expZ, sigZ, z);
+}
+
+#endif
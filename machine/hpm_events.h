@@ -0,0 +1,72 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_HPM_EVENTS_H
+#define _RISCV_HPM_EVENTS_H
+
+// mhpmevent encodings of the CHERI cores' performance events
+#define EVENT_REDIRECT                0x1
+#define EVENT_BRANCH                  0x3
+#define EVENT_JAL                     0x4
+#define EVENT_JALR                    0x5
+#define EVENT_TRAP                    0x2
+
+#define EVENT_LOAD_WAIT              0x10
+#define EVENT_CAP_LOAD               0x1a
+#define EVENT_CAP_STORE              0x1b
+
+#define EVENT_ITLB_MISS              0x2a
+#define EVENT_ICACHE_LOAD            0x20
+#define EVENT_ICACHE_LOAD_MISS       0x21
+#define EVENT_ICACHE_LOAD_MISS_WAIT  0x22
+
+#define EVENT_DTLB_ACCESS            0x39
+#define EVENT_DTLB_MISS              0x3a
+#define EVENT_DTLB_MISS_WAIT         0x3b
+#define EVENT_DCACHE_LOAD            0x30
+#define EVENT_DCACHE_LOAD_MISS       0x31
+#define EVENT_DCACHE_LOAD_MISS_WAIT  0x32
+#define EVENT_DCACHE_STORE           0x33
+#define EVENT_DCACHE_STORE_MISS      0x34
+
+#define EVENT_LLCACHE_FILL           0x61
+#define EVENT_LLCACHE_FILL_WAIT      0x62
+#define EVENT_LLCACHE_EVICT          0x64
+
+#define EVENT_TAGCACHE_LOAD          0x42
+#define EVENT_TAGCACHE_LOAD_MISS     0x43
+#define EVENT_TAGCACHE_STORE         0x40
+#define EVENT_TAGCACHE_STORE_MISS    0x41
+#define EVENT_TAGCACHE_EVICT         0x44
+
+// Every event above, for the counter multiplexer
+#define HPM_EVENT_LIST(X) \
+  X(EVENT_REDIRECT,              "redirect") \
+  X(EVENT_BRANCH,                "branch") \
+  X(EVENT_JAL,                   "jal") \
+  X(EVENT_JALR,                  "jalr") \
+  X(EVENT_TRAP,                  "trap") \
+  X(EVENT_LOAD_WAIT,             "load_wait") \
+  X(EVENT_CAP_LOAD,              "cap_load") \
+  X(EVENT_CAP_STORE,             "cap_store") \
+  X(EVENT_ITLB_MISS,             "itlb_miss") \
+  X(EVENT_ICACHE_LOAD,           "icache_load") \
+  X(EVENT_ICACHE_LOAD_MISS,      "icache_load_miss") \
+  X(EVENT_ICACHE_LOAD_MISS_WAIT, "icache_load_miss_wait") \
+  X(EVENT_DTLB_ACCESS,           "dtlb_access") \
+  X(EVENT_DTLB_MISS,             "dtlb_miss") \
+  X(EVENT_DTLB_MISS_WAIT,        "dtlb_miss_wait") \
+  X(EVENT_DCACHE_LOAD,           "dcache_load") \
+  X(EVENT_DCACHE_LOAD_MISS,      "dcache_load_miss") \
+  X(EVENT_DCACHE_LOAD_MISS_WAIT, "dcache_load_miss_wait") \
+  X(EVENT_DCACHE_STORE,          "dcache_store") \
+  X(EVENT_DCACHE_STORE_MISS,     "dcache_store_miss") \
+  X(EVENT_LLCACHE_FILL,          "llcache_fill") \
+  X(EVENT_LLCACHE_FILL_WAIT,     "llcache_fill_wait") \
+  X(EVENT_LLCACHE_EVICT,         "llcache_evict") \
+  X(EVENT_TAGCACHE_LOAD,         "tagcache_load") \
+  X(EVENT_TAGCACHE_LOAD_MISS,    "tagcache_load_miss") \
+  X(EVENT_TAGCACHE_STORE,        "tagcache_store") \
+  X(EVENT_TAGCACHE_STORE_MISS,   "tagcache_store_miss") \
+  X(EVENT_TAGCACHE_EVICT,        "tagcache_evict")
+
+#endif
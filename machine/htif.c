@@ -89,16 +89,22 @@ void htif_syscall(uintptr_t arg)
   do_tohost_fromhost(0, 0, arg);
 }
 
-void htif_console_putchar(uint8_t ch)
+// Proxy a write system call, so the whole buffer goes in one transfer
+void htif_console_write(const uint8_t *buf, size_t len)
 {
-#if __riscv_xlen == 32
-  // HTIF devices are not supported on RV32, so proxy a write system call
   volatile uint64_t magic_mem[8];
   magic_mem[0] = SYS_write;
   magic_mem[1] = 1;
-  magic_mem[2] = (uintptr_t)&ch;
-  magic_mem[3] = 1;
+  magic_mem[2] = (uintptr_t)buf;
+  magic_mem[3] = len;
   do_tohost_fromhost(0, 0, (uintptr_t)magic_mem);
+}
+
+void htif_console_putchar(uint8_t ch)
+{
+#if __riscv_xlen == 32
+  // HTIF devices are not supported on RV32
+  htif_console_write(&ch, 1);
 #else
   spinlock_lock(&htif_lock);
     __set_tohost(1, 1, ch);
@@ -128,7 +134,7 @@ static void htif_open(const struct fdt_scan_node *node, void *extra)
 static void htif_prop(const struct fdt_scan_prop *prop, void *extra)
 {
   struct htif_scan *scan = (struct htif_scan *)extra;
-  if (!strcmp(prop->name, "compatible") && fdt_string_list_index(prop, "ucb,htif0") >= 0) {
+  if (fdt_prop_is(prop, FDT_PROP_COMPATIBLE) && fdt_string_list_index(prop, "ucb,htif0") >= 0) {
     scan->compat = 1;
   }
 }
@@ -152,5 +158,5 @@ void query_htif(uintptr_t fdt)
   cb.done = htif_done;
   cb.extra = &scan;
 
-  fdt_scan(fdt, &cb);
+  fdt_scan_compatible(fdt, "ucb,htif0", &cb);
 }
@@ -3,6 +3,7 @@
 #ifndef _RISCV_HTIF_H
 #define _RISCV_HTIF_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #if __riscv_xlen == 64
@@ -20,6 +21,7 @@
 extern uintptr_t htif;
 void query_htif(uintptr_t dtb);
 void htif_console_putchar(uint8_t);
+void htif_console_write(const uint8_t *buf, size_t len);
 int htif_console_getchar();
 void htif_poweroff() __attribute__((noreturn));
 void htif_syscall(uintptr_t);
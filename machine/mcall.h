@@ -13,6 +13,78 @@
 #define SBI_REMOTE_SFENCE_VMA_ASID 7
 #define SBI_SHUTDOWN 8
 
+// SBI v0.2 and later: extension in a7, function in a6, error and value in a0 and a1
+#define SBI_SPEC_VERSION ((2 << 24) | 0)
+#define SBI_IMPL_ID 0 // Berkeley Boot Loader
+#define SBI_IMPL_VERSION 1
+
+#define SBI_EXT_BASE 0x10
+#define SBI_EXT_BASE_GET_SPEC_VERSION 0
+#define SBI_EXT_BASE_GET_IMP_ID 1
+#define SBI_EXT_BASE_GET_IMP_VERSION 2
+#define SBI_EXT_BASE_PROBE_EXT 3
+#define SBI_EXT_BASE_GET_MVENDORID 4
+#define SBI_EXT_BASE_GET_MARCHID 5
+#define SBI_EXT_BASE_GET_MIMPID 6
+
+#define SBI_EXT_TIME 0x54494D45
+#define SBI_EXT_TIME_SET_TIMER 0
+
+#define SBI_EXT_IPI 0x735049
+#define SBI_EXT_IPI_SEND_IPI 0
+
+#define SBI_EXT_RFENCE 0x52464E43
+#define SBI_EXT_RFENCE_REMOTE_FENCE_I 0
+#define SBI_EXT_RFENCE_REMOTE_SFENCE_VMA 1
+#define SBI_EXT_RFENCE_REMOTE_SFENCE_VMA_ASID 2
+
+#define SBI_EXT_DBCN 0x4442434E
+#define SBI_EXT_DBCN_CONSOLE_WRITE 0
+#define SBI_EXT_DBCN_CONSOLE_READ 1
+#define SBI_EXT_DBCN_CONSOLE_WRITE_BYTE 2
+
+#define SBI_EXT_PMU 0x504D55
+#define SBI_EXT_PMU_NUM_COUNTERS 0
+#define SBI_EXT_PMU_COUNTER_GET_INFO 1
+#define SBI_EXT_PMU_COUNTER_CONFIG_MATCHING 2
+#define SBI_EXT_PMU_COUNTER_START 3
+#define SBI_EXT_PMU_COUNTER_STOP 4
+#define SBI_EXT_PMU_COUNTER_FW_READ 5
+#define SBI_EXT_PMU_COUNTER_FW_READ_HI 6
+
+// event_idx is a type in bits 19:16 and a code in bits 15:0
+#define SBI_PMU_EVENT_TYPE(event) (((event) >> 16) & 0xf)
+#define SBI_PMU_EVENT_TYPE_HW 0
+#define SBI_PMU_EVENT_TYPE_CACHE 1
+#define SBI_PMU_EVENT_TYPE_RAW 2
+#define SBI_PMU_EVENT_TYPE_FW 15
+#define SBI_PMU_HW_CPU_CYCLES 1
+#define SBI_PMU_HW_INSTRUCTIONS 2
+
+#define SBI_PMU_CFG_FLAG_SKIP_MATCH 0x1
+#define SBI_PMU_CFG_FLAG_CLEAR_VALUE 0x2
+#define SBI_PMU_CFG_FLAG_AUTO_START 0x4
+#define SBI_PMU_CFG_FLAG_SET_VUINH 0x8
+#define SBI_PMU_CFG_FLAG_SET_VSINH 0x10
+#define SBI_PMU_CFG_FLAG_SET_UINH 0x20
+#define SBI_PMU_CFG_FLAG_SET_SINH 0x40
+#define SBI_PMU_CFG_FLAG_SET_MINH 0x80
+#define SBI_PMU_START_FLAG_SET_INIT_VALUE 0x1
+#define SBI_PMU_STOP_FLAG_RESET 0x1
+
+// In the firmware-specific space, for --enable-mstats and --enable-hpm-mux.
+// Counters are read as XLEN-bit words: on RV32, word 1 is the high half.
+#define SBI_EXT_MSTATS (0x0A000000 + SBI_IMPL_ID)
+#define SBI_EXT_MSTATS_NUM_COUNTERS 0
+#define SBI_EXT_MSTATS_READ 1 // hart, counter, word
+#define SBI_EXT_MSTATS_READ_CYCLES 2 // hart, counter, word
+#define SBI_EXT_MSTATS_RESET 3 // hart mask, base
+#define SBI_EXT_MSTATS_MUX_NUM_EVENTS 4
+#define SBI_EXT_MSTATS_MUX_EVENT 5 // event; returns its mhpmevent value
+#define SBI_EXT_MSTATS_MUX_READ 6 // hart, event, word
+#define SBI_EXT_MSTATS_MUX_READ_ENABLED 7 // hart, event, word; mtime ticks
+#define SBI_EXT_MSTATS_MUX_READ_RUNNING 8 // hart, word; mtime ticks
+
 #define SBI_SUCCESS 0
 #define SBI_ERR_FAILED -1
 #define SBI_ERR_NOT_SUPPORTED -2
@@ -20,5 +92,13 @@
 #define SBI_ERR_DENIED -4
 #define SBI_ERR_INVALID_ADDRESS -5
 #define SBI_ERR_ALREADY_AVAILABLE -6
+#define SBI_ERR_ALREADY_STARTED -7
+#define SBI_ERR_ALREADY_STOPPED -8
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+
+void sbi_ecall(uintptr_t* regs, uintptr_t mepc);
+#endif
 
 #endif
@@ -0,0 +1,194 @@
+// See LICENSE for license details.
+
+#include "mconsole.h"
+#include "mtrap.h"
+#include "atomic.h"
+#include "uart.h"
+#include "uart16550.h"
+#include "htif.h"
+#ifdef PK_STATIC_PLATFORM
+#include "platform_profile.h"
+#endif
+
+// Free-running indices; the rings hold [tail, head)
+static uint8_t tx_ring[CONSOLE_TX_RING];
+static unsigned tx_head, tx_tail;
+static uint8_t rx_ring[CONSOLE_RX_RING];
+static unsigned rx_head, rx_tail;
+static spinlock_t console_lock = SPINLOCK_INIT;
+
+#ifdef PK_ENABLE_CONSOLE_IRQ
+uint32_t console_irq;
+static volatile uint32_t* console_claim;
+static int console_tx_irq;
+#endif
+
+// Hand the device as much of buf as it takes without waiting
+static size_t console_tx(const uint8_t *buf, size_t len)
+{
+#if defined(PLATFORM_UART_BASE)
+  return uart_write(buf, len);
+#elif defined(PLATFORM_UART16550_BASE)
+  return uart16550_write(buf, len);
+#elif defined(PLATFORM_HTIF)
+  htif_console_write(buf, len);
+  return len;
+#elif !defined(BBL_GFE)
+  if (uart) {
+    return uart_write(buf, len);
+  } else if (uart16550) {
+    return uart16550_write(buf, len);
+  } else if (htif) {
+    htif_console_write(buf, len);
+    return len;
+  }
+  return len; // nowhere to write it
+#else
+  return uart16550_write(buf, len);
+#endif
+}
+
+static int console_rx()
+{
+#if defined(PLATFORM_UART_BASE)
+  return uart_getchar();
+#elif defined(PLATFORM_UART16550_BASE)
+  return uart16550_getchar();
+#elif defined(PLATFORM_HTIF)
+  return htif_console_getchar();
+#else
+  if (uart) {
+    return uart_getchar();
+  } else if (uart16550) {
+    return uart16550_getchar();
+  } else if (htif) {
+    return htif_console_getchar();
+  } else {
+    return -1;
+  }
+#endif
+}
+
+// Send from the ring until it is empty or the device is full
+static void console_drain()
+{
+  while (tx_tail != tx_head) {
+    unsigned start = tx_tail % CONSOLE_TX_RING;
+    size_t len = tx_head - tx_tail;
+    if (len > CONSOLE_TX_RING - start)
+      len = CONSOLE_TX_RING - start;
+    size_t n = console_tx(tx_ring + start, len);
+    tx_tail += n;
+    if (n < len)
+      break;
+  }
+}
+
+#ifdef PK_ENABLE_CONSOLE_IRQ
+static void console_irq_enable(int tx)
+{
+  if (tx == console_tx_irq)
+    return;
+  console_tx_irq = tx;
+  if (uart)
+    uart_irq_enable(tx);
+  else
+    uart16550_irq_enable(tx);
+}
+#endif
+
+void console_write(const uint8_t *buf, size_t len)
+{
+  spinlock_lock(&console_lock);
+    for (size_t i = 0; i < len; i++) {
+      while (tx_head - tx_tail == CONSOLE_TX_RING)
+        console_drain();
+      tx_ring[tx_head++ % CONSOLE_TX_RING] = buf[i];
+    }
+    console_drain();
+
+    // Without the interrupt to send the rest, nothing may be left behind
+#ifdef PK_ENABLE_CONSOLE_IRQ
+    if (console_claim)
+      console_irq_enable(tx_tail != tx_head);
+    else
+#endif
+    while (tx_tail != tx_head)
+      console_drain();
+  spinlock_unlock(&console_lock);
+}
+
+void console_putchar(uint8_t ch)
+{
+  console_write(&ch, 1);
+}
+
+void console_flush()
+{
+  spinlock_lock(&console_lock);
+    while (tx_tail != tx_head)
+      console_drain();
+  spinlock_unlock(&console_lock);
+}
+
+int console_getchar()
+{
+  int ch;
+
+  spinlock_lock(&console_lock);
+    if (rx_tail != rx_head)
+      ch = rx_ring[rx_tail++ % CONSOLE_RX_RING];
+    else
+      ch = console_rx();
+  spinlock_unlock(&console_lock);
+
+  return ch;
+}
+
+size_t console_read(uint8_t *buf, size_t len)
+{
+  size_t n = 0;
+  for (int ch; n < len && (ch = console_getchar()) >= 0; )
+    buf[n++] = ch;
+  return n;
+}
+
+#ifdef PK_ENABLE_CONSOLE_IRQ
+void console_irq_init()
+{
+  if (uart)
+    console_irq = uart_irq;
+  else if (uart16550)
+    console_irq = uart16550_irq;
+  if (!console_irq || console_irq > plic_ndevs || !HLS()->plic_m_ie) {
+    console_irq = 0;
+    return;
+  }
+
+  // The claim/complete register follows the context's threshold
+  console_claim = HLS()->plic_m_thresh + 1;
+  HLS()->plic_m_ie[console_irq / 32] |= 1U << (console_irq % 32);
+  console_tx_irq = -1;
+  console_irq_enable(0);
+  set_csr(mie, MIP_MEIP);
+}
+
+void console_interrupt()
+{
+  uint32_t irq;
+
+  while ((irq = *console_claim)) {
+    if (irq == console_irq) {
+      spinlock_lock(&console_lock);
+        // Read everything to quiet the device, dropping what does not fit
+        for (int ch; (ch = console_rx()) >= 0; )
+          if (rx_head - rx_tail < CONSOLE_RX_RING)
+            rx_ring[rx_head++ % CONSOLE_RX_RING] = ch;
+        console_drain();
+        console_irq_enable(tx_tail != tx_head);
+      spinlock_unlock(&console_lock);
+    }
+    *console_claim = irq;
+  }
+}
+#endif
@@ -0,0 +1,29 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_MCONSOLE_H
+#define _RISCV_MCONSOLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Ring sizes; both must be powers of two
+#define CONSOLE_TX_RING 1024
+#define CONSOLE_RX_RING 256
+
+// Characters are queued and handed to the UART a FIFO's worth at a time.
+// Without interrupts, each write waits for the ring to drain.
+void console_putchar(uint8_t ch);
+void console_write(const uint8_t *buf, size_t len);
+int console_getchar(); // -1 if nothing has been received
+size_t console_read(uint8_t *buf, size_t len);
+void console_flush();
+
+#ifdef PK_ENABLE_CONSOLE_IRQ
+// PLIC source of the console UART, or 0 if it cannot interrupt M-mode
+extern uint32_t console_irq;
+// Route the console interrupt to this hart's M-mode PLIC context
+void console_irq_init();
+void console_interrupt();
+#endif
+
+#endif
@@ -6,11 +6,16 @@
 #include "fp_emulation.h"
 #include "fdt.h"
 #include "uart.h"
+#include "mconsole.h"
+#include "mlog.h"
 #include "uart16550.h"
 #include "finisher.h"
 #include "disabled_hart_mask.h"
 #include "htif.h"
 #include "string.h"
+#include "boot_profile.h"
+#include "pmu.h"
+#include "hpm_events.h"
 #if __has_feature(capabilities)
 #include <cheri_init_globals.h>
 #endif
@@ -115,6 +120,9 @@ static void fp_init()
 
 hls_t* hls_init(uintptr_t id)
 {
+  _Static_assert(sizeof(hls_t) <= HLS_SIZE, "hls_t does not fit in HLS_SIZE");
+  _Static_assert(offsetof(hls_t, sstc) == MENTRY_SSTC_OFFSET - MENTRY_HLS_OFFSET, "mentry.S has the wrong sstc offset");
+  _Static_assert(offsetof(hls_t, timecmp) == MENTRY_TIMECMP_OFFSET - MENTRY_HLS_OFFSET, "mentry.S has the wrong timecmp offset");
   hls_t* hls = OTHER_HLS(id);
   memset(hls, 0, sizeof(*hls));
   return hls;
@@ -127,43 +135,9 @@ static void memory_init()
 
 static void hpm_init()
 {
-
-// TODO have those defined in a separate header? Where should that live?
-#define EVENT_REDIRECT                0x1
-#define EVENT_BRANCH                  0x3
-#define EVENT_JAL                     0x4
-#define EVENT_JALR                    0x5
-#define EVENT_TRAP                    0x2
-
-#define EVENT_LOAD_WAIT              0x10
-#define EVENT_CAP_LOAD               0x1a
-#define EVENT_CAP_STORE              0x1b
-
-#define EVENT_ITLB_MISS              0x2a
-#define EVENT_ICACHE_LOAD            0x20
-#define EVENT_ICACHE_LOAD_MISS       0x21
-#define EVENT_ICACHE_LOAD_MISS_WAIT  0x22
-
-#define EVENT_DTLB_ACCESS            0x39
-#define EVENT_DTLB_MISS              0x3a
-#define EVENT_DTLB_MISS_WAIT         0x3b
-#define EVENT_DCACHE_LOAD            0x30
-#define EVENT_DCACHE_LOAD_MISS       0x31
-#define EVENT_DCACHE_LOAD_MISS_WAIT  0x32
-#define EVENT_DCACHE_STORE           0x33
-#define EVENT_DCACHE_STORE_MISS      0x34
-
-#define EVENT_LLCACHE_FILL           0x61
-#define EVENT_LLCACHE_FILL_WAIT      0x62
-#define EVENT_LLCACHE_EVICT          0x64
-
-#define EVENT_TAGCACHE_LOAD          0x42
-#define EVENT_TAGCACHE_LOAD_MISS     0x43
-#define EVENT_TAGCACHE_STORE         0x40
-#define EVENT_TAGCACHE_STORE_MISS    0x41
-#define EVENT_TAGCACHE_EVICT         0x44
-
-// TODO have those derived from a config file? What's an appropriate mechanism?
+// The events counted until S-mode configures counters through the SBI PMU
+// extension.  With a riscv,pmu node, hart_pmu_init clears them instead,
+// and the counter multiplexer replaces them.
 #define EVENT_3  EVENT_REDIRECT
 #define EVENT_4  EVENT_BRANCH
 #define EVENT_5  EVENT_JAL
@@ -331,6 +305,11 @@ static void plic_init()
 {
   for (size_t i = 1; i <= plic_ndevs; i++)
     plic_priorities[i] = 1;
+#ifdef PK_ENABLE_CONSOLE_IRQ
+  // Above the M-mode threshold, so the console UART interrupts bbl
+  if (console_irq)
+    plic_priorities[console_irq] = 2;
+#endif
 }
 
 static void prci_test()
@@ -364,6 +343,10 @@ static void hart_plic_init()
         HLS()->plic_s_ie[i] = __UINT32_MAX__;
      }
   }
+#ifdef PK_ENABLE_CONSOLE_IRQ
+  if (console_irq && HLS()->plic_s_ie)
+    HLS()->plic_s_ie[console_irq / 32] &= ~(1U << (console_irq % 32));
+#endif
   *HLS()->plic_m_thresh = 1;
   if (HLS()->plic_s_thresh) {
       // Supervisor not always present
@@ -371,26 +354,69 @@ static void hart_plic_init()
   }
 }
 
+// With Sstc, S-mode compares time against its own stimecmp, so neither
+// setting the timer nor taking its interrupt needs M-mode
+static void hart_sstc_init()
+{
+  if (!HLS()->sstc)
+    return;
+
+#if __riscv_xlen == 32
+  set_csr(menvcfgh, MENVCFGH_STCE);
+  HLS()->sstc = (read_csr(menvcfgh) & MENVCFGH_STCE) != 0;
+#else
+  set_csr(menvcfg, MENVCFG_STCE);
+  HLS()->sstc = (read_csr(menvcfg) & MENVCFG_STCE) != 0;
+#endif
+  if (!HLS()->sstc) {
+    printm("hart %ld: riscv,isa has sstc, but menvcfg.STCE is not writable\r\n",
+           read_csr(mhartid));
+    return;
+  }
+
+#if __riscv_xlen == 32
+  write_csr(stimecmph, -1);
+#endif
+  write_csr(stimecmp, -1);
+}
+
 static void wake_harts()
 {
-  for (int hart = 0; hart < MAX_HARTS; ++hart)
-    if ((((~disabled_hart_mask & hart_mask) >> hart) & 1))
+  for_each_hart(hart, &hart_mask)
+    if (!hart_mask_test(&disabled_hart_mask, hart))
       *OTHER_HLS(hart)->ipi = 1; // wakeup the hart
 }
 
 void init_first_hart(uintptr_t hartid, uintptr_t dtb)
 {
+  boot_phase("reset");
+  mlog_set_drain_hart(hartid);
+
+  // Index the device tree once so the queries below can go straight to their nodes
+  fdt_index(dtb);
+  boot_phase("fdt_index");
+
   // Confirm console as early as possible
+#if defined(PK_STATIC_PLATFORM)
+  query_platform_console();
+#else
 #ifndef BBL_GFE
   query_uart(dtb);
 #endif
   query_uart16550(dtb);
   query_htif(dtb);
+#endif
   printm("bbl loader\r\n");
+  boot_phase("console");
 
   hart_init();
   hls_init(0); // this might get called again from parse_config_string
+  boot_phase("hart_init");
 
+#ifdef PK_STATIC_PLATFORM
+  // Everything but the payload location was fixed at build time
+  query_platform();
+#else
   // Find the power button early as well so die() works
   query_finisher(dtb);
 
@@ -399,7 +425,13 @@ void init_first_hart(uintptr_t hartid, uintptr_t dtb)
   query_harts(dtb);
   query_clint(dtb);
   query_plic(dtb);
+#endif
   query_chosen(dtb);
+  query_pmu(dtb);
+#ifdef PK_ENABLE_CONSOLE_IRQ
+  console_irq_init();
+#endif
+  boot_phase("fdt_query");
 
 #ifndef BBL_GFE
   wake_harts();
@@ -407,8 +439,11 @@ void init_first_hart(uintptr_t hartid, uintptr_t dtb)
 
   plic_init();
   hart_plic_init();
+  hart_sstc_init();
+  hart_pmu_init();
   //prci_test();
   memory_init();
+  boot_phase("plic_init");
   boot_loader(dtb);
 }
 
@@ -416,6 +451,8 @@ void init_other_hart(uintptr_t hartid, uintptr_t dtb)
 {
   hart_init();
   hart_plic_init();
+  hart_sstc_init();
+  hart_pmu_init();
   boot_other_hart(dtb);
 }
 
@@ -4,6 +4,7 @@
 #include "fp_emulation.h"
 #include "unprivileged_memory.h"
 #include "mtrap.h"
+#include "mstats.h"
 #include "config.h"
 #include "pk.h"
 
@@ -13,8 +14,16 @@ union byte_array {
   uint64_t int64;
 };
 
+// Accesses that cross a page go byte by byte, so that a fault on either
+// page reports the first byte it could not access.
+static inline int crosses_page(uintptr_t addr, int len)
+{
+  return (addr & (RISCV_PGSIZE - 1)) + len > RISCV_PGSIZE;
+}
+
 void misaligned_load_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
 {
+  uintptr_t start = mstats_begin();
   union byte_array val;
   uintptr_t mstatus;
   insn_t insn = get_insn(mepc, &mstatus);
@@ -69,6 +78,11 @@ void misaligned_load_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
   }
 
   val.int64 = 0;
+#if !__has_feature(capabilities)
+  if (len <= sizeof(uintptr_t) && !crosses_page(addr, len))
+    val.intx = load_misaligned(addr, len, mepc);
+  else
+#endif
   for (unsigned i = 0; i < len; i++)
     val.bytes[i] = load_uint8_t((void *)(addr + i), mepc);
 
@@ -84,10 +98,12 @@ void misaligned_load_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
 #else
   write_csr(mepc, npc);
 #endif
+  mstats_end(MSTATS_MISALIGNED_LOAD, start);
 }
 
 void misaligned_store_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
 {
+  uintptr_t start = mstats_begin();
   union byte_array val;
   uintptr_t mstatus;
   insn_t insn = get_insn(mepc, &mstatus);
@@ -138,6 +154,11 @@ void misaligned_store_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
     return redirect_trap(mepc, mstatus, addr);
   }
 
+#if !__has_feature(capabilities)
+  if (len <= sizeof(uintptr_t) && !crosses_page(addr, len))
+    store_misaligned(addr, val.intx, len, mepc);
+  else
+#endif
   for (int i = 0; i < len; i++)
     store_uint8_t((void *)(addr + i), val.bytes[i], mepc);
 
@@ -146,4 +167,5 @@ void misaligned_store_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
 #else
   write_csr(mepc, npc);
 #endif
+  mstats_end(MSTATS_MISALIGNED_STORE, start);
 }
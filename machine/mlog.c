@@ -0,0 +1,122 @@
+// See LICENSE for license details.
+
+#include "mlog.h"
+#include "mconsole.h"
+#include "atomic.h"
+#include "string.h"
+
+struct mlog_ring mlog[MAX_HARTS];
+static uint32_t mlog_seq;
+static uintptr_t mlog_drain_hart;
+static spinlock_t mlog_drain_lock = SPINLOCK_INIT;
+
+#define MLOG_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+static void mlog_copy_in(struct mlog_ring *ring, unsigned long pos, const void *src, size_t len)
+{
+  size_t start = pos % MLOG_RING_SIZE, first = MLOG_RING_SIZE - start;
+  if (first > len)
+    first = len;
+  memcpy(ring->buf + start, src, first);
+  memcpy(ring->buf, (const char *)src + first, len - first);
+}
+
+static void mlog_copy_out(const struct mlog_ring *ring, unsigned long pos, void *dest, size_t len)
+{
+  size_t start = pos % MLOG_RING_SIZE, first = MLOG_RING_SIZE - start;
+  if (first > len)
+    first = len;
+  memcpy(dest, ring->buf + start, first);
+  memcpy((char *)dest + first, ring->buf, len - first);
+}
+
+void mlog_write(const char *text, size_t len)
+{
+  uintptr_t hart = read_csr(mhartid);
+  if (hart >= MAX_HARTS)
+    return;
+
+  struct mlog_ring *ring = &mlog[hart];
+  struct mlog_record rec;
+  size_t size = sizeof(rec) + MLOG_ALIGN(len);
+
+  ring->magic = MLOG_MAGIC;
+  if (size > MLOG_RING_SIZE - (ring->head - ring->tail)) {
+    // Never wait on the drainer; the count is reported at the next flush
+    atomic_add(&ring->dropped, 1);
+    return;
+  }
+
+  rec.time = mtime ? *mtime : 0;
+  rec.seq = atomic_add(&mlog_seq, 1);
+  rec.len = len;
+  rec.pad = 0;
+  mlog_copy_in(ring, ring->head, &rec, sizeof(rec));
+  mlog_copy_in(ring, ring->head + sizeof(rec), text, len);
+
+  // Publish the record only once it is complete
+  mb();
+  ring->head += size;
+}
+
+static void mlog_drain()
+{
+  while (1) {
+    struct mlog_ring *next = NULL;
+    struct mlog_record rec, next_rec;
+
+    // The oldest record at the tail of any ring
+    for (int i = 0; i < MAX_HARTS; i++) {
+      struct mlog_ring *ring = &mlog[i];
+      if (ring->tail == ring->head)
+        continue;
+      mb();
+      mlog_copy_out(ring, ring->tail, &rec, sizeof(rec));
+      if (!next || (int32_t)(rec.seq - next_rec.seq) < 0) {
+        next = ring;
+        next_rec = rec;
+      }
+    }
+    if (!next)
+      return;
+
+    size_t start = (next->tail + sizeof(next_rec)) % MLOG_RING_SIZE, len = next_rec.len;
+    size_t first = MLOG_RING_SIZE - start < len ? MLOG_RING_SIZE - start : len;
+    console_write((const uint8_t *)next->buf + start, first);
+    console_write((const uint8_t *)next->buf, len - first);
+
+    mb();
+    next->tail += sizeof(next_rec) + MLOG_ALIGN(len);
+  }
+}
+
+void mlog_flush()
+{
+  spinlock_lock(&mlog_drain_lock);
+    mlog_drain();
+    for (int i = 0; i < MAX_HARTS; i++) {
+      uint32_t dropped = mlog[i].dropped;
+      if (dropped) {
+        char buf[64];
+        int n = snprintf(buf, sizeof(buf), "[%d records dropped on hart %d]\r\n", dropped, i);
+        console_write((const uint8_t *)buf, n);
+        atomic_add(&mlog[i].dropped, -dropped);
+      }
+    }
+  spinlock_unlock(&mlog_drain_lock);
+}
+
+void mlog_poll()
+{
+  if (read_csr(mhartid) != mlog_drain_hart)
+    return;
+  // Nothing to do is the common case; skip the lock for it
+  for (int i = 0; i < MAX_HARTS; i++)
+    if (mlog[i].tail != mlog[i].head || mlog[i].dropped)
+      return mlog_flush();
+}
+
+void mlog_set_drain_hart(uintptr_t hart)
+{
+  mlog_drain_hart = hart;
+}
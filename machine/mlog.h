@@ -0,0 +1,40 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_MLOG_H
+#define _RISCV_MLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mtrap.h"
+
+// printm output goes into a ring owned by the printing hart, and reaches
+// the console when the draining hart gets to it, in the order it was logged.
+// The rings are left in memory ("mlog") to be read from a dump.
+#define MLOG_RING_SIZE 4096 // per hart; a power of two
+#define MLOG_MAGIC 0x676f6c6d // "mlog"
+
+struct mlog_record {
+  uint64_t time;  // mtime, or 0 before the CLINT has been found
+  uint32_t seq;   // global order
+  uint16_t len;   // of the text that follows, padded to 8 bytes
+  uint16_t pad;
+};
+
+struct mlog_ring {
+  uint32_t magic;
+  uint32_t dropped;
+  volatile unsigned long head; // only the owning hart writes records
+  volatile unsigned long tail; // only the draining hart consumes them
+  char buf[MLOG_RING_SIZE];
+};
+
+extern struct mlog_ring mlog[MAX_HARTS];
+
+void mlog_write(const char *text, size_t len);
+// Copy everything logged so far to the console
+void mlog_flush();
+// Flush if this is the draining hart
+void mlog_poll();
+void mlog_set_drain_hart(uintptr_t hart);
+
+#endif
@@ -0,0 +1,77 @@
+// See LICENSE for license details.
+
+#include "mstats.h"
+#include "mlog.h"
+#include "fdt.h"
+#include "string.h"
+
+#ifdef PK_ENABLE_MSTATS
+
+struct mstats mstats[MAX_HARTS];
+
+_Static_assert(sizeof(struct mstats) == 1 << MSTATS_SHIFT, "mentry.S indexes mstats by shifting");
+
+static const char* const mstats_names[MSTATS_NUM] = {
+  [MSTATS_MISALIGNED_LOAD] = "misaligned load",
+  [MSTATS_MISALIGNED_STORE] = "misaligned store",
+  [MSTATS_EMUL_MULDIV] = "emulated mul/div",
+  [MSTATS_EMUL_FP] = "emulated fp",
+  [MSTATS_EMUL_CSR] = "emulated csr",
+  [MSTATS_ILLEGAL] = "illegal instruction",
+  [MSTATS_IRQ_TIMER] = "timer interrupt",
+  [MSTATS_IRQ_IPI] = "ipi",
+  [MSTATS_SBI_LEGACY + SBI_SET_TIMER] = "sbi set_timer",
+  [MSTATS_SBI_LEGACY + SBI_CONSOLE_PUTCHAR] = "sbi console_putchar",
+  [MSTATS_SBI_LEGACY + SBI_CONSOLE_GETCHAR] = "sbi console_getchar",
+  [MSTATS_SBI_LEGACY + SBI_CLEAR_IPI] = "sbi clear_ipi",
+  [MSTATS_SBI_LEGACY + SBI_SEND_IPI] = "sbi send_ipi",
+  [MSTATS_SBI_LEGACY + SBI_REMOTE_FENCE_I] = "sbi remote_fence_i",
+  [MSTATS_SBI_LEGACY + SBI_REMOTE_SFENCE_VMA] = "sbi remote_sfence_vma",
+  [MSTATS_SBI_LEGACY + SBI_REMOTE_SFENCE_VMA_ASID] = "sbi remote_sfence_vma_asid",
+  [MSTATS_SBI_LEGACY + SBI_SHUTDOWN] = "sbi shutdown",
+  [MSTATS_SBI_BASE] = "sbi base",
+  [MSTATS_SBI_TIME] = "sbi time",
+  [MSTATS_SBI_IPI] = "sbi ipi",
+  [MSTATS_SBI_RFENCE] = "sbi rfence",
+  [MSTATS_SBI_DBCN] = "sbi dbcn",
+  [MSTATS_SBI_MSTATS] = "sbi mstats",
+  [MSTATS_SBI_OTHER] = "sbi other",
+};
+
+// A hart may be counting while another resets it; an event can be lost
+void mstats_reset(uintptr_t hart)
+{
+  memset(&mstats[hart], 0, sizeof(mstats[hart]));
+}
+
+void mstats_print()
+{
+  for_each_hart(hart, &hart_mask) {
+    struct mstats* s = &mstats[hart];
+    printm("mstats hart %d:\r\n", (int)hart);
+    for (int i = 0; i < MSTATS_NUM; i++) {
+      if (!s->count[i])
+        continue;
+#ifdef PK_MSTATS_CYCLES
+      printm("  %s: %lld, %lld cycles\r\n", mstats_names[i],
+             (long long)s->count[i], (long long)s->cycles[i]);
+#else
+      printm("  %s: %lld\r\n", mstats_names[i], (long long)s->count[i]);
+#endif
+    }
+    // Drain each hart's table before the log ring can fill
+    mlog_flush();
+  }
+}
+
+#else
+
+void mstats_reset(uintptr_t hart)
+{
+}
+
+void mstats_print()
+{
+}
+
+#endif
@@ -0,0 +1,93 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_MSTATS_H
+#define _RISCV_MSTATS_H
+
+#include "mtrap.h"
+#include "mcall.h"
+
+// Counts of the traps M-mode handles on S-mode's behalf, per hart.  The
+// interrupts and fast traps in mentry.S are counted but not timed.
+#define MSTATS_MISALIGNED_LOAD 0
+#define MSTATS_MISALIGNED_STORE 1
+#define MSTATS_EMUL_MULDIV 2
+#define MSTATS_EMUL_FP 3
+#define MSTATS_EMUL_CSR 4
+#define MSTATS_ILLEGAL 5 // redirected to S-mode
+#define MSTATS_IRQ_TIMER 6
+#define MSTATS_IRQ_IPI 7
+#define MSTATS_SBI_LEGACY 8 // plus the legacy function, up to SBI_SHUTDOWN
+#define MSTATS_SBI_BASE 17
+#define MSTATS_SBI_TIME 18
+#define MSTATS_SBI_IPI 19
+#define MSTATS_SBI_RFENCE 20
+#define MSTATS_SBI_DBCN 21
+#define MSTATS_SBI_MSTATS 22
+#define MSTATS_SBI_OTHER 23
+#define MSTATS_NUM 24
+
+// log2 of sizeof(struct mstats), for mentry.S to index by hart
+#ifdef PK_MSTATS_CYCLES
+# define MSTATS_SHIFT 9
+#else
+# define MSTATS_SHIFT 8
+#endif
+
+#ifndef __ASSEMBLER__
+
+// Each hart only adds to its own; aligned so harts do not share lines
+struct mstats {
+  uint64_t count[MSTATS_NUM];
+#ifdef PK_MSTATS_CYCLES
+  uint64_t cycles[MSTATS_NUM];
+#endif
+} __attribute__((aligned(1 << MSTATS_SHIFT)));
+
+extern struct mstats mstats[MAX_HARTS];
+
+static inline uintptr_t mstats_begin()
+{
+#ifdef PK_MSTATS_CYCLES
+  return read_csr(mcycle);
+#else
+  return 0;
+#endif
+}
+
+// Count an event that is not timed
+static inline void mstats_count(int counter)
+{
+#ifdef PK_ENABLE_MSTATS
+  mstats[read_csr(mhartid)].count[counter]++;
+#endif
+}
+
+// Count an event, and the cycles since start
+static inline void mstats_end(int counter, uintptr_t start)
+{
+  mstats_count(counter);
+#ifdef PK_MSTATS_CYCLES
+  mstats[read_csr(mhartid)].cycles[counter] += (unsigned long)(read_csr(mcycle) - start);
+#endif
+}
+
+static inline int mstats_sbi_counter(uintptr_t ext)
+{
+  switch (ext)
+  {
+    case SBI_EXT_BASE: return MSTATS_SBI_BASE;
+    case SBI_EXT_TIME: return MSTATS_SBI_TIME;
+    case SBI_EXT_IPI: return MSTATS_SBI_IPI;
+    case SBI_EXT_RFENCE: return MSTATS_SBI_RFENCE;
+    case SBI_EXT_DBCN: return MSTATS_SBI_DBCN;
+    case SBI_EXT_MSTATS: return MSTATS_SBI_MSTATS;
+  }
+  return ext <= SBI_SHUTDOWN ? MSTATS_SBI_LEGACY + ext : MSTATS_SBI_OTHER;
+}
+
+void mstats_reset(uintptr_t hart);
+void mstats_print();
+
+#endif // !__ASSEMBLER__
+
+#endif
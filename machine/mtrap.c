@@ -6,8 +6,10 @@
 #include "atomic.h"
 #include "bits.h"
 #include "vm.h"
-#include "uart.h"
-#include "uart16550.h"
+#include "mconsole.h"
+#include "mlog.h"
+#include "mstats.h"
+#include "pmu.h"
 #include "finisher.h"
 #include "fdt.h"
 #include "unprivileged_memory.h"
@@ -21,31 +23,22 @@ void __attribute__((noreturn)) bad_trap(uintptr_t* regs, uintptr_t dummy, uintpt
 
 static uintptr_t mcall_console_putchar(uint8_t ch)
 {
-#ifndef BBL_GFE
-  if (uart) {
-    uart_putchar(ch);
-  } else if (uart16550) {
-    uart16550_putchar(ch);
-  } else if (htif) {
-    htif_console_putchar(ch);
-  }
-#else
-  uart16550_putchar(ch);
-#endif
+  console_putchar(ch);
   return 0;
 }
 
 void putstring(const char* s)
 {
   while (*s)
-    mcall_console_putchar(*s++);
+    console_putchar(*s++);
 }
 
 void vprintm(const char* s, va_list vl)
 {
   char buf[256];
-  vsnprintf(buf, sizeof buf, s, vl);
-  putstring(buf);
+  int len = vsnprintf(buf, sizeof buf, s, vl);
+  mlog_write(buf, len < sizeof(buf) ? len : sizeof(buf) - 1);
+  mlog_poll();
 }
 
 void printm(const char* s, ...)
@@ -57,25 +50,27 @@ void printm(const char* s, ...)
   va_end(vl);
 }
 
-static void send_ipi(uintptr_t recipient, int event)
+// Every event is posted before any hart is interrupted, so the MSIP
+// writes go out back to back
+static void send_ipis(const hart_mask_t* mask, int event)
 {
-  if (((disabled_hart_mask >> recipient) & 1)) return;
-  atomic_or(&OTHER_HLS(recipient)->mipi_pending, event);
+  for_each_hart(hart, mask)
+    atomic_or(&OTHER_HLS(hart)->mipi_pending, event);
   mb();
-  *OTHER_HLS(recipient)->ipi = 1;
+  for_each_hart(hart, mask)
+    *OTHER_HLS(hart)->ipi = 1;
+}
+
+// The harts in mask that exist and will take an IPI
+static void ipi_targets(hart_mask_t* targets, const hart_mask_t* mask)
+{
+  for (size_t i = 0; i < HART_MASK_WORDS; i++)
+    targets->bits[i] = mask->bits[i] & hart_mask.bits[i] & ~disabled_hart_mask.bits[i];
 }
 
 static uintptr_t mcall_console_getchar()
 {
-  if (uart) {
-    return uart_getchar();
-  } else if (uart16550) {
-    return uart16550_getchar();
-  } else if (htif) {
-    return htif_console_getchar();
-  } else {
-    return '\0';
-  }
+  return console_getchar();
 }
 
 static uintptr_t mcall_clear_ipi()
@@ -88,40 +83,141 @@ static uintptr_t mcall_shutdown()
   poweroff(0);
 }
 
-static uintptr_t mcall_set_timer(uint64_t when)
+uintptr_t mcall_set_timer(uint64_t when)
 {
+  if (HLS()->sstc) {
+    // STIP follows stimecmp, which S-mode could have written itself
+#if __riscv_xlen == 32
+    write_csr(stimecmph, -1);
+    write_csr(stimecmp, (uint32_t)when);
+    write_csr(stimecmph, when >> 32);
+#else
+    write_csr(stimecmp, when);
+#endif
+    return 0;
+  }
+
+#ifdef PK_HPM_MUX
+  // mtimecmp is shared with the counter multiplexer
+  hpm_mux_set_timer(when);
+  clear_csr(mip, MIP_STIP);
+#else
   *HLS()->timecmp = when;
   clear_csr(mip, MIP_STIP);
   set_csr(mie, MIP_MTIP);
+#endif
   return 0;
 }
 
-static void send_ipi_many(uintptr_t* pmask, int event)
+static void sfence_vma_range(const struct sfence_request* req)
 {
-  _Static_assert(MAX_HARTS <= 8 * sizeof(*pmask), "# harts > uintptr_t bits");
-  uintptr_t mask = hart_mask;
-  if (pmask)
-#if __has_feature(capabilities)
-    mask &= load_uintptr_t(pmask, read_scr(mepcc));
-#else
-    mask &= load_uintptr_t(pmask, read_csr(mepc));
-#endif
+  if (req->size > SFENCE_VMA_MAX_PAGES * RISCV_PGSIZE) {
+    if (req->asid == SFENCE_ASID_ALL)
+      asm volatile ("sfence.vma" ::: "memory");
+    else
+      asm volatile ("sfence.vma zero, %0" :: "r"(req->asid) : "memory");
+    return;
+  }
+
+  unsigned long addr = req->start & -RISCV_PGSIZE;
+  unsigned long len = req->size + (req->start - addr);
+  for (unsigned long off = 0; off < len; off += RISCV_PGSIZE) {
+    if (req->asid == SFENCE_ASID_ALL)
+      asm volatile ("sfence.vma %0" :: "r"(addr + off) : "memory");
+    else
+      asm volatile ("sfence.vma %0, %1" :: "r"(addr + off), "r"(req->asid) : "memory");
+  }
+}
 
-  // send IPIs to everyone
-  for (uintptr_t i = 0, m = mask; m; i++, m >>= 1)
-    if (m & 1)
-      send_ipi(i, event);
+// Perform the fences other harts have requested of this one, if any
+static void fence_service()
+{
+  hls_t* hls = HLS();
+  struct sfence_request req[SFENCE_QUEUE_LEN];
+  hart_mask_t senders;
+  int fence_i, count;
 
-  if (event == IPI_SOFT)
+  if (!atomic_read(&hls->fence_i) && !atomic_read(&hls->sfence_count))
     return;
 
-  // wait until all events have been handled.
-  // prevent deadlock by consuming incoming IPIs.
+  spinlock_lock(&hls->fence_lock);
+    fence_i = hls->fence_i;
+    count = hls->sfence_count;
+    if (count <= SFENCE_QUEUE_LEN)
+      memcpy(req, hls->sfence, count * sizeof(*req));
+    senders = hls->fence_senders;
+    memset(&hls->fence_senders, 0, sizeof(hls->fence_senders));
+    hls->fence_i = 0;
+    hls->sfence_count = 0;
+  spinlock_unlock(&hls->fence_lock);
+
+  if (fence_i)
+    asm volatile ("fence.i" ::: "memory");
+  if (count > SFENCE_QUEUE_LEN)
+    asm volatile ("sfence.vma" ::: "memory");
+  else
+    for (int i = 0; i < count; i++)
+      sfence_vma_range(&req[i]);
+  mb();
+
+  for_each_hart(hart, &senders)
+    atomic_add(&OTHER_HLS(hart)->fence_acks, -1);
+}
+
+void fence_trap(uintptr_t* regs, uintptr_t dummy, uintptr_t mepc)
+{
+  fence_service();
+}
+
+// Queue a fence on a hart: a fence.i, or an sfence.vma if req is set.
+// The sender is owed one acknowledgement per hart it has fences queued on.
+static void fence_request(uintptr_t hart, const struct sfence_request* req)
+{
+  hls_t* hls = OTHER_HLS(hart);
+  uintptr_t self = read_csr(mhartid);
+  int i;
+
+  spinlock_lock(&hls->fence_lock);
+    if (!req) {
+      hls->fence_i = 1;
+    } else {
+      for (i = 0; i < hls->sfence_count && i < SFENCE_QUEUE_LEN; i++)
+        if (hls->sfence[i].start == req->start && hls->sfence[i].size == req->size &&
+            hls->sfence[i].asid == req->asid)
+          break;
+      if (i == hls->sfence_count) {
+        if (i < SFENCE_QUEUE_LEN)
+          hls->sfence[i] = *req;
+        hls->sfence_count = i < SFENCE_QUEUE_LEN ? i + 1 : SFENCE_QUEUE_LEN + 1;
+      }
+    }
+    if (!hart_mask_test(&hls->fence_senders, self)) {
+      hart_mask_set(&hls->fence_senders, self);
+      atomic_add(&HLS()->fence_acks, 1);
+    }
+  spinlock_unlock(&hls->fence_lock);
+}
+
+// Wait until every hart in mask has taken its IPI, or without a mask, until
+// every fence this hart has requested has completed.  Prevent deadlock by
+// consuming incoming IPIs and fence requests in the meantime.
+static void wait_ipi_many(const hart_mask_t* mask)
+{
   uint32_t incoming_ipi = 0;
-  for (uintptr_t i = 0, m = mask; m; i++, m >>= 1)
-    if (m & 1)
-      while (*OTHER_HLS(i)->ipi)
+
+  if (!mask) {
+    while (atomic_read(&HLS()->fence_acks)) {
+      incoming_ipi |= atomic_swap(HLS()->ipi, 0);
+      fence_service();
+    }
+  } else {
+    for_each_hart(hart, mask) {
+      while (*OTHER_HLS(hart)->ipi) {
         incoming_ipi |= atomic_swap(HLS()->ipi, 0);
+        fence_service();
+      }
+    }
+  }
 
   // if we got an IPI, restore it; it will be taken after returning
   if (incoming_ipi) {
@@ -130,6 +226,77 @@ static void send_ipi_many(uintptr_t* pmask, int event)
   }
 }
 
+void send_ipi_many(const hart_mask_t* mask, int event)
+{
+  hart_mask_t targets;
+
+  // Disabled harts never take the IPI, so do not wait for them
+  ipi_targets(&targets, mask);
+
+  // An ACLINT SSWI raises SSIP without interrupting the hart into M-mode
+  if (event == IPI_SOFT) {
+    mb();
+    for_each_hart(hart, &targets) {
+      if (OTHER_HLS(hart)->sswi) {
+        *OTHER_HLS(hart)->sswi = 1;
+        hart_mask_clear(&targets, hart);
+      }
+    }
+  }
+
+  send_ipis(&targets, event);
+  if (event != IPI_SOFT)
+    wait_ipi_many(&targets);
+}
+
+static void remote_fence(const hart_mask_t* mask, const struct sfence_request* req)
+{
+  hart_mask_t targets;
+
+  ipi_targets(&targets, mask);
+  for_each_hart(hart, &targets)
+    fence_request(hart, req);
+
+  send_ipis(&targets, req ? IPI_SFENCE_VMA : IPI_FENCE_I);
+  wait_ipi_many(NULL);
+}
+
+void remote_fence_i(const hart_mask_t* mask)
+{
+  remote_fence(mask, NULL);
+}
+
+void remote_sfence_vma(const hart_mask_t* mask, uintptr_t start, uintptr_t size, uintptr_t asid)
+{
+  struct sfence_request req = { start, size, asid };
+
+  if ((start == 0 && size == 0) || size == (uintptr_t)-1)
+    req.size = -1UL;
+  remote_fence(mask, &req);
+}
+
+// Legacy calls pass the hart mask by reference, or NULL for all harts.
+// Only the words that can name an existing hart are read.
+static void legacy_hart_mask(hart_mask_t* mask, uintptr_t* pmask)
+{
+  size_t words = HART_MASK_WORDS;
+
+  if (!pmask) {
+    *mask = hart_mask;
+    return;
+  }
+
+  memset(mask, 0, sizeof(*mask));
+  while (words > 1 && !hart_mask.bits[words - 1])
+    words--;
+  for (size_t i = 0; i < words; i++)
+#if __has_feature(capabilities)
+    mask->bits[i] = load_uintptr_t(pmask + i, read_scr(mepcc));
+#else
+    mask->bits[i] = load_uintptr_t(pmask + i, read_csr(mepc));
+#endif
+}
+
 void mcall_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
 {
 #if __has_feature(capabilities)
@@ -138,7 +305,16 @@ void mcall_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
   write_csr(mepc, mepc + 4);
 #endif
 
-  uintptr_t n = regs[17], arg0 = regs[10], arg1 = regs[11], retval, ipi_type;
+  uintptr_t n = regs[17], arg0 = regs[10], arg1 = regs[11], retval;
+  uintptr_t start = mstats_begin();
+  hart_mask_t mask;
+
+  if (n >= SBI_EXT_BASE) {
+    sbi_ecall(regs, mepc);
+    mstats_end(mstats_sbi_counter(n), start);
+    mlog_poll();
+    return;
+  }
 
   switch (n)
   {
@@ -149,17 +325,25 @@ void mcall_trap(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc)
       retval = mcall_console_getchar();
       break;
     case SBI_SEND_IPI:
-      ipi_type = IPI_SOFT;
-      goto send_ipi;
+#ifndef BBL_GFE
+      legacy_hart_mask(&mask, (uintptr_t*)arg0);
+      send_ipi_many(&mask, IPI_SOFT);
+#endif
+      retval = 0;
+      break;
     case SBI_REMOTE_SFENCE_VMA:
     case SBI_REMOTE_SFENCE_VMA_ASID:
-      ipi_type = IPI_SFENCE_VMA;
-      goto send_ipi;
+#ifndef BBL_GFE
+      legacy_hart_mask(&mask, (uintptr_t*)arg0);
+      remote_sfence_vma(&mask, arg1, regs[12],
+                        n == SBI_REMOTE_SFENCE_VMA_ASID ? regs[13] : SFENCE_ASID_ALL);
+#endif
+      retval = 0;
+      break;
     case SBI_REMOTE_FENCE_I:
-      ipi_type = IPI_FENCE_I;
-send_ipi:
 #ifndef BBL_GFE
-      send_ipi_many((uintptr_t*)arg0, ipi_type);
+      legacy_hart_mask(&mask, (uintptr_t*)arg0);
+      remote_fence_i(&mask);
 #endif
       retval = 0;
       break;
@@ -181,6 +365,8 @@ send_ipi:
       break;
   }
   regs[10] = retval;
+  mstats_end(mstats_sbi_counter(n), start);
+  mlog_poll();
 }
 
 void redirect_trap(uintptr_t epc, uintptr_t mstatus, uintptr_t badaddr)
@@ -240,6 +426,13 @@ fail:
   bad_trap(regs, mcause, mepc);
 }
 
+#ifdef PK_ENABLE_CONSOLE_IRQ
+void external_interrupt_trap(uintptr_t* regs, uintptr_t dummy, uintptr_t mepc)
+{
+  console_interrupt();
+}
+#endif
+
 void trap_from_machine_mode(uintptr_t* regs, uintptr_t dummy, uintptr_t mepc)
 {
   uintptr_t mcause = read_csr(mcause);
@@ -259,7 +452,11 @@ void trap_from_machine_mode(uintptr_t* regs, uintptr_t dummy, uintptr_t mepc)
 
 void poweroff(uint16_t code)
 {
+  mstats_print();
+  hpm_mux_print();
   printm("Power off\r\n");
+  mlog_flush();
+  console_flush();
 #ifdef BBL_GFE
   while (1);
 #endif
@@ -267,7 +464,7 @@ void poweroff(uint16_t code)
   if (htif) {
     htif_poweroff();
   } else {
-    send_ipi_many(0, IPI_HALT);
+    send_ipi_many(&hart_mask, IPI_HALT);
 #ifndef BBL_GFE
     while (1) { asm volatile ("wfi\n"); }
 #endif
@@ -4,18 +4,28 @@
 #define _RISCV_MTRAP_H
 
 #include "encoding.h"
-
-#ifdef __riscv_atomic
-# define MAX_HARTS 8 // arbitrary
-#else
-# define MAX_HARTS 1
+#include "config.h"
+
+// Configured by --with-max-harts; each hart has a machine stack in .bss
+#ifndef MAX_HARTS
+# ifdef __riscv_atomic
+#  define MAX_HARTS 8 // arbitrary
+# else
+#  define MAX_HARTS 1
+# endif
+#endif
+#if MAX_HARTS > 1 && !defined(__riscv_atomic)
+# error "multiple harts need the A extension"
 #endif
+// Hart masks are kept in whole 16-byte units
+#define HART_MASK_BYTES (((MAX_HARTS) + 127) / 128 * 16)
 
 #ifndef __ASSEMBLER__
 
 #include <stdint.h>
 #include <stddef.h>
 #include <stdarg.h>
+#include "atomic.h"
 
 #define read_const_csr(reg) ({ unsigned long __tmp; \
   asm ("csrr %0, " #reg : "=r"(__tmp)); \
@@ -36,25 +46,92 @@ extern volatile uint64_t* mtime;
 extern volatile uint32_t* plic_priorities;
 extern size_t plic_ndevs;
 
+// A set of hart IDs below MAX_HARTS
+typedef struct {
+  unsigned long bits[HART_MASK_BYTES / sizeof(unsigned long)];
+} hart_mask_t;
+
+#define HART_MASK_WORDS (sizeof(hart_mask_t) / sizeof(unsigned long))
+#define HART_MASK_WORD_BITS (8 * sizeof(unsigned long))
+
+static inline int hart_mask_test(const hart_mask_t* mask, uintptr_t hart)
+{
+  return hart < MAX_HARTS &&
+    ((mask->bits[hart / HART_MASK_WORD_BITS] >> (hart % HART_MASK_WORD_BITS)) & 1);
+}
+
+static inline void hart_mask_set(hart_mask_t* mask, uintptr_t hart)
+{
+  mask->bits[hart / HART_MASK_WORD_BITS] |= 1UL << (hart % HART_MASK_WORD_BITS);
+}
+
+static inline void hart_mask_clear(hart_mask_t* mask, uintptr_t hart)
+{
+  mask->bits[hart / HART_MASK_WORD_BITS] &= ~(1UL << (hart % HART_MASK_WORD_BITS));
+}
+
+// The first hart in mask at or after hart, or MAX_HARTS if there is none
+static inline uintptr_t hart_mask_next(const hart_mask_t* mask, uintptr_t hart)
+{
+  for (; hart < MAX_HARTS; hart++) {
+    unsigned long word = mask->bits[hart / HART_MASK_WORD_BITS] >> (hart % HART_MASK_WORD_BITS);
+    if (!word)
+      hart |= HART_MASK_WORD_BITS - 1; // nothing more in this word
+    else if (word & 1)
+      return hart;
+  }
+  return MAX_HARTS;
+}
+
+#define for_each_hart(hart, mask) \
+  for (uintptr_t hart = hart_mask_next(mask, 0); hart < MAX_HARTS; \
+       hart = hart_mask_next(mask, hart + 1))
+
+// A remote sfence.vma; asid is SFENCE_ASID_ALL for a global fence
+struct sfence_request {
+  unsigned long start;
+  unsigned long size;
+  unsigned long asid;
+};
+
+#define SFENCE_ASID_ALL (-1UL)
+#define SFENCE_VMA_MAX_PAGES 64 // above this, flush the whole address space
+#define SFENCE_QUEUE_LEN 4
+
 typedef struct {
   volatile uint32_t* ipi;
   volatile int mipi_pending;
+  int sstc; // S-mode programs its own timer through stimecmp
 
   volatile uint64_t* timecmp;
+  volatile uint32_t* sswi; // ACLINT SSWI register raising this hart's SSIP
 
   volatile uint32_t* plic_m_thresh;
   volatile uint32_t* plic_m_ie;
   volatile uint32_t* plic_s_thresh;
   volatile uint32_t* plic_s_ie;
+
+  // Fences requested by other harts: a fence.i, and queued sfence.vmas,
+  // where an overflow flushes the whole TLB.  Once they are done, each
+  // hart in fence_senders has its fence_acks decremented.
+  spinlock_t fence_lock;
+  int fence_i;
+  int sfence_count; // SFENCE_QUEUE_LEN + 1 after an overflow
+  struct sfence_request sfence[SFENCE_QUEUE_LEN];
+  volatile int fence_acks; // harts yet to complete this hart's fences
+  hart_mask_t fence_senders;
+
+  uint32_t pmu_present; // counters mcountinhibit can stop
+  uint32_t pmu_used; // counters configured through the SBI PMU extension
 } hls_t;
 
 #define MACHINE_STACK_TOP() ({ \
   uintptr_t sp = (uintptr_t)__builtin_frame_address(0) ; \
-  (char *)((sp + RISCV_PGSIZE) & -RISCV_PGSIZE); })
+  (char *)((sp + MACHINE_STACK_SIZE) & -MACHINE_STACK_SIZE); })
 
 // hart-local storage, at top of stack
 #define HLS() ((hls_t*)(MACHINE_STACK_TOP() - HLS_SIZE))
-#define OTHER_HLS(id) ((hls_t*)ptr_to_ddccap((char*)HLS() + RISCV_PGSIZE * ((id) - read_const_csr(mhartid))))
+#define OTHER_HLS(id) ((hls_t*)ptr_to_ddccap((char*)HLS() + MACHINE_STACK_SIZE * ((id) - read_const_csr(mhartid))))
 
 hls_t* hls_init(uintptr_t hart_id);
 void parse_config_string();
@@ -66,6 +143,13 @@ void vprintm(const char *s, va_list args)
 #endif
 	;
 void putstring(const char* s);
+
+// Shared by the legacy and v0.2 SBI calls; masks are of hart IDs from 0.
+// Fences return once every hart in the mask has completed them.
+uintptr_t mcall_set_timer(uint64_t when);
+void send_ipi_many(const hart_mask_t* mask, int event);
+void remote_fence_i(const hart_mask_t* mask);
+void remote_sfence_vma(const hart_mask_t* mask, uintptr_t start, uintptr_t size, uintptr_t asid);
 #define assert(x) ({ if (!(x)) die("assertion failed: %s", #x); })
 #define die(str, ...) ({ printm("%s:%d: " str "\r\n", __FILE__, __LINE__, ##__VA_ARGS__); poweroff(-1); })
 
@@ -95,6 +179,8 @@ static inline void wfi()
 #define MENTRY_FRAME_SIZE (MENTRY_HLS_OFFSET + HLS_SIZE)
 #define MENTRY_IPI_OFFSET (MENTRY_HLS_OFFSET)
 #define MENTRY_IPI_PENDING_OFFSET (MENTRY_HLS_OFFSET + REGBYTES)
+#define MENTRY_SSTC_OFFSET (MENTRY_HLS_OFFSET + REGBYTES + 4)
+#define MENTRY_TIMECMP_OFFSET (MENTRY_HLS_OFFSET + REGBYTES + 8)
 
 #ifdef __riscv_flen
 # define SOFT_FLOAT_CONTEXT_SIZE 0
@@ -103,10 +189,10 @@ static inline void wfi()
 #endif
 #if __has_feature(capabilities)
 #define INTEGER_CONTEXT_SIZE (33 * REGBYTES)
-#define HLS_SIZE 128
+#define HLS_SIZE (256 + HART_MASK_BYTES)
 #else
 #define INTEGER_CONTEXT_SIZE (32 * REGBYTES)
-#define HLS_SIZE 64
+#define HLS_SIZE (256 + HART_MASK_BYTES)
 #endif
 
 #endif
@@ -4,35 +4,119 @@
 
 #ifndef __riscv_muldiv
 
-#if __riscv_xlen == 64
-typedef __int128 double_int;
-#else
-typedef int64_t double_int;
-#endif
+#define XLEN (8 * sizeof(uintptr_t))
+
+// Without M, the compiler would turn even these helpers' operators into
+// libgcc calls, so they are built from shifts and adds.  Each loop ends
+// as soon as the bits that are left cannot change the result.
+
+static inline uintptr_t mul(uintptr_t a, uintptr_t b)
+{
+  uintptr_t res = 0;
+  if (a < b) {
+    uintptr_t t = a; a = b; b = t;
+  }
+  for (; b; b >>= 1, a <<= 1)
+    if (b & 1)
+      res += a;
+  return res;
+}
+
+// The high half of the unsigned double-width product
+static inline uintptr_t mulhu(uintptr_t a, uintptr_t b)
+{
+  uintptr_t lo = 0, hi = 0, a_hi = 0;
+  if (a < b) {
+    uintptr_t t = a; a = b; b = t;
+  }
+  for (; b; b >>= 1) {
+    if (b & 1) {
+      lo += a;
+      hi += a_hi + (lo < a);
+    }
+    a_hi = a_hi << 1 | a >> (XLEN - 1);
+    a <<= 1;
+  }
+  return hi;
+}
+
+static inline uintptr_t mulh(uintptr_t a, uintptr_t b)
+{
+  return mulhu(a, b) - ((intptr_t)a < 0 ? b : 0) - ((intptr_t)b < 0 ? a : 0);
+}
 
-// These routines rely on the compiler to turn these operations into libcalls
-// when not natively supported.  So work on making those go fast.
+static inline uintptr_t mulhsu(uintptr_t a, uintptr_t b)
+{
+  return mulhu(a, b) - ((intptr_t)a < 0 ? b : 0);
+}
+
+// Restoring division with the divisor first lined up under the dividend's
+// top bit.  Division by zero gives all ones, and the dividend as remainder.
+static inline uintptr_t divu(uintptr_t n, uintptr_t d, uintptr_t* rem)
+{
+  uintptr_t q = 0, bit = 1;
+
+  if (d == 0) {
+    *rem = n;
+    return -1;
+  }
+  if (n < d) {
+    *rem = n;
+    return 0;
+  }
+
+  while (!(d >> (XLEN - 1)) && (d << 1) <= n) {
+    d <<= 1;
+    bit <<= 1;
+  }
+  for (; bit; d >>= 1, bit >>= 1) {
+    if (n >= d) {
+      n -= d;
+      q |= bit;
+    }
+  }
+  *rem = n;
+  return q;
+}
+
+// The quotient's sign is the operands' combined sign and the remainder's is
+// the dividend's, which gives the most negative number / -1 its RISC-V
+// result of itself with no remainder.
+static inline uintptr_t divs(uintptr_t n, uintptr_t d, uintptr_t* rem)
+{
+  int n_neg = (intptr_t)n < 0, d_neg = (intptr_t)d < 0;
+  uintptr_t q, r;
+
+  if (d == 0) {
+    *rem = n;
+    return -1;
+  }
+
+  q = divu(n_neg ? -n : n, d_neg ? -d : d, &r);
+  *rem = n_neg ? -r : r;
+  return n_neg != d_neg ? -q : q;
+}
 
 DECLARE_EMULATION_FUNC(emulate_mul_div)
 {
-  uintptr_t rs1 = GET_RS1(insn, regs), rs2 = GET_RS2(insn, regs), val;
+  uintptr_t rs1 = GET_RS1(insn, regs), rs2 = GET_RS2(insn, regs), val, rem;
 
   if ((insn & MASK_MUL) == MATCH_MUL)
-    val = rs1 * rs2;
+    val = mul(rs1, rs2);
   else if ((insn & MASK_DIV) == MATCH_DIV)
-    val = (intptr_t)rs1 / (intptr_t)rs2;
+    val = divs(rs1, rs2, &rem);
   else if ((insn & MASK_DIVU) == MATCH_DIVU)
-    val = rs1 / rs2;
+    val = divu(rs1, rs2, &rem);
   else if ((insn & MASK_REM) == MATCH_REM)
-    val = (intptr_t)rs1 % (intptr_t)rs2;
+    divs(rs1, rs2, &val);
   else if ((insn & MASK_REMU) == MATCH_REMU)
-    val = rs1 % rs2;
+    divu(rs1, rs2, &val);
   else if ((insn & MASK_MULH) == MATCH_MULH)
-    val = ((double_int)(intptr_t)rs1 * (double_int)(intptr_t)rs2) >> (8 * sizeof(rs1));
+    val = mulh(rs1, rs2);
   else if ((insn & MASK_MULHU) == MATCH_MULHU)
-    val = ((double_int)rs1 * (double_int)rs2) >> (8 * sizeof(rs1));
+    val = mulhu(rs1, rs2);
   else if ((insn & MASK_MULHSU) == MATCH_MULHSU)
-    val = ((double_int)(intptr_t)rs1 * (double_int)rs2) >> (8 * sizeof(rs1));
+    val = mulhsu(rs1, rs2);
   else
     return truly_illegal_insn(regs, mcause, mepc, mstatus, insn);
 
@@ -43,19 +127,21 @@ DECLARE_EMULATION_FUNC(emulate_mul_div)
 
 DECLARE_EMULATION_FUNC(emulate_mul_div32)
 {
+  // The 32-bit operands, extended as each operation reads them
   uint32_t rs1 = GET_RS1(insn, regs), rs2 = GET_RS2(insn, regs);
+  uintptr_t rs1_s = (int32_t)rs1, rs2_s = (int32_t)rs2, rem;
   int32_t val;
 
   if ((insn & MASK_MULW) == MATCH_MULW)
-    val = rs1 * rs2;
+    val = mul(rs1, rs2);
   else if ((insn & MASK_DIVW) == MATCH_DIVW)
-    val = (int32_t)rs1 / (int32_t)rs2;
+    val = divs(rs1_s, rs2_s, &rem);
   else if ((insn & MASK_DIVUW) == MATCH_DIVUW)
-    val = rs1 / rs2;
+    val = divu(rs1, rs2, &rem);
   else if ((insn & MASK_REMW) == MATCH_REMW)
-    val = (int32_t)rs1 % (int32_t)rs2;
+    divs(rs1_s, rs2_s, &rem), val = rem;
   else if ((insn & MASK_REMUW) == MATCH_REMUW)
-    val = rs1 % rs2;
+    divu(rs1, rs2, &rem), val = rem;
   else
     return truly_illegal_insn(regs, mcause, mepc, mstatus, insn);
 
@@ -0,0 +1,663 @@
+// See LICENSE for license details.
+
+#include "pmu.h"
+#include "mtrap.h"
+#include "mcall.h"
+#include "fdt.h"
+#include "mlog.h"
+#include "hpm_events.h"
+#include "string.h"
+
+// From the riscv,pmu node: the mhpmevent value for each SBI event, the
+// counters each range of SBI events may use, and the counters each raw
+// event may use, once masked.
+#define PMU_MAX_MAPS 32
+
+struct pmu_event_map {
+  uint32_t event;
+  uint64_t mhpmevent;
+};
+
+struct pmu_counter_map {
+  uint32_t first, last;
+  uint32_t counters;
+};
+
+struct pmu_raw_map {
+  uint64_t select, mask;
+  uint32_t counters;
+};
+
+static struct pmu_event_map pmu_events[PMU_MAX_MAPS];
+static struct pmu_counter_map pmu_counters[PMU_MAX_MAPS];
+static struct pmu_raw_map pmu_raw[PMU_MAX_MAPS];
+static int pmu_nevents, pmu_ncounters, pmu_nraw;
+static int pmu_fdt; // a riscv,pmu node was found
+static int pmu_hpm_width; // implemented bits in the HPM counters
+static int pmu_sscofpmf; // overflow sets OF in mhpmevent and raises LCOFI
+
+// The mhpmevent bits Sscofpmf adds above the event
+#define PMU_EVENT_FLAGS (MHPMEVENT_OF | MHPMEVENT_MINH | MHPMEVENT_SINH | \
+  MHPMEVENT_UINH | MHPMEVENT_VSINH | MHPMEVENT_VUINH)
+
+#define HPM_COUNTERS(X) \
+  X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) \
+  X(15) X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25) \
+  X(26) X(27) X(28) X(29) X(30) X(31)
+
+#if __riscv_xlen == 32
+# define write_counter(reg, value) ({ write_csr(reg, 0); \
+  write_csr(reg##h, (value) >> 32); write_csr(reg, (uint32_t)(value)); })
+# define read_counter(reg) ({ uint32_t hi, lo; \
+  do { hi = read_csr(reg##h); lo = read_csr(reg); } \
+  while (hi != read_csr(reg##h)); \
+  ((uint64_t)hi << 32) | lo; })
+#else
+# define write_counter(reg, value) write_csr(reg, value)
+# define read_counter(reg) ((uint64_t)read_csr(reg))
+#endif
+
+// CSR numbers are immediates, so counters are reached through a switch.
+// On RV32, Sscofpmf's bits are in mhpmeventNh, which only it provides.
+static void pmu_write_event(int counter, uint64_t event)
+{
+  switch (counter)
+  {
+#if __riscv_xlen == 32
+#define X(n) case n: write_csr(mhpmevent##n, (uint32_t)event); \
+    if (pmu_sscofpmf) { write_csr(mhpmevent##n##h, event >> 32); } break;
+#else
+#define X(n) case n: write_csr(mhpmevent##n, event); break;
+#endif
+    HPM_COUNTERS(X)
+#undef X
+  }
+}
+
+static uint64_t pmu_read_event(int counter)
+{
+  switch (counter)
+  {
+#if __riscv_xlen == 32
+#define X(n) case n: return read_csr(mhpmevent##n) | \
+    (pmu_sscofpmf ? (uint64_t)read_csr(mhpmevent##n##h) << 32 : 0);
+#else
+#define X(n) case n: return read_csr(mhpmevent##n);
+#endif
+    HPM_COUNTERS(X)
+#undef X
+  }
+  return 0;
+}
+
+static void pmu_write_counter(int counter, uint64_t value)
+{
+  switch (counter)
+  {
+    case 0: write_counter(mcycle, value); break;
+    case 2: write_counter(minstret, value); break;
+#define X(n) case n: write_counter(mhpmcounter##n, value); break;
+    HPM_COUNTERS(X)
+#undef X
+  }
+}
+
+static uint64_t pmu_read_counter(int counter)
+{
+  switch (counter)
+  {
+    case 0: return read_counter(mcycle);
+    case 2: return read_counter(minstret);
+#define X(n) case n: return read_counter(mhpmcounter##n);
+    HPM_COUNTERS(X)
+#undef X
+  }
+  return 0;
+}
+
+// The counters mcountinhibit can stop, or none if it is not implemented
+static uint32_t pmu_probe()
+{
+  unsigned long present = 0;
+
+#if __has_feature(capabilities)
+  asm volatile ("cllc ct1, 1f\n\t"
+                "cspecialrw ct1, mtcc, ct1\n\t"
+                "csrr t0, mcountinhibit\n\t"
+                "csrw mcountinhibit, %1\n\t"
+                "csrr %0, mcountinhibit\n\t"
+                "csrw mcountinhibit, t0\n\t"
+                ".align 2\n\t"
+                "1: cspecialw mtcc, ct1"
+                : "+r" (present) : "r" (-1UL) : "t0", "ct1");
+#else
+  asm volatile ("la t1, 1f\n\t"
+                "csrrw t1, mtvec, t1\n\t"
+                "csrr t0, mcountinhibit\n\t"
+                "csrw mcountinhibit, %1\n\t"
+                "csrr %0, mcountinhibit\n\t"
+                "csrw mcountinhibit, t0\n\t"
+                ".align 2\n\t"
+                "1: csrw mtvec, t1"
+                : "+r" (present) : "r" (-1UL) : "t0", "t1");
+#endif
+  return present & ~2UL;
+}
+
+// The HPM counters keep as many low bits as they implement
+static int pmu_probe_width(int counter)
+{
+  uint64_t saved, ones;
+  int width = 0;
+
+  set_csr(mcountinhibit, 1UL << counter);
+  saved = pmu_read_counter(counter);
+  pmu_write_counter(counter, -1ULL);
+  ones = pmu_read_counter(counter);
+  pmu_write_counter(counter, saved);
+  clear_csr(mcountinhibit, 1UL << counter);
+
+  for (; width < 64 && (ones & 1); ones >>= 1)
+    width++;
+  return width;
+}
+
+void hart_pmu_init()
+{
+  hls_t* hls = HLS();
+
+  hls->pmu_present = pmu_probe();
+  hls->pmu_used = 0;
+
+#ifndef PK_HPM_MUX
+  // LCOFI can only be delegated with Sscofpmf; S-mode takes it directly
+  if (hls->pmu_present & ~PMU_FIXED_COUNTERS) {
+    set_csr(mideleg, MIP_LCOFIP);
+    pmu_sscofpmf = (read_csr(mideleg) & MIP_LCOFIP) != 0;
+  }
+#endif
+
+  for (int i = 3; i < PMU_COUNTERS; i++) {
+    if (!((hls->pmu_present >> i) & 1))
+      continue;
+    if (!pmu_hpm_width)
+      pmu_hpm_width = pmu_probe_width(i);
+    // With a riscv,pmu node, S-mode picks the events, not hpm_init
+    if (pmu_fdt) {
+      set_csr(mcountinhibit, 1UL << i);
+      pmu_write_event(i, 0);
+    }
+  }
+
+#ifdef PK_HPM_MUX
+  // The multiplexer keeps the HPM counters; S-mode gets cycle and instret
+  hpm_mux_start(hls->pmu_present & ~PMU_FIXED_COUNTERS);
+  hls->pmu_present &= PMU_FIXED_COUNTERS;
+#endif
+}
+
+///////////////////////////////////////////// FDT SCAN /////////////////////////////////////////
+
+struct pmu_scan
+{
+  int compat;
+};
+
+static void pmu_open(const struct fdt_scan_node *node, void *extra)
+{
+  struct pmu_scan *scan = (struct pmu_scan *)extra;
+  memset(scan, 0, sizeof(*scan));
+}
+
+static uint64_t pmu_cells64(const uint32_t *value)
+{
+  return ((uint64_t)fdt_cell(&value[0]) << 32) | fdt_cell(&value[1]);
+}
+
+// Entries past PMU_MAX_MAPS are dropped
+static void pmu_prop(const struct fdt_scan_prop *prop, void *extra)
+{
+  struct pmu_scan *scan = (struct pmu_scan *)extra;
+  const uint32_t *value = prop->value;
+
+  if (fdt_prop_is(prop, FDT_PROP_COMPATIBLE) && fdt_string_list_index(prop, "riscv,pmu") >= 0) {
+    scan->compat = 1;
+  } else if (fdt_prop_is(prop, FDT_PROP_PMU_EVENTS)) {
+    // <event mhpmevent-hi mhpmevent-lo>
+    for (int i = 0; i + 3 <= prop->len / 4 && pmu_nevents < PMU_MAX_MAPS; i += 3) {
+      pmu_events[pmu_nevents].event = fdt_cell(&value[i]);
+      pmu_events[pmu_nevents++].mhpmevent = pmu_cells64(&value[i + 1]);
+    }
+  } else if (fdt_prop_is(prop, FDT_PROP_PMU_COUNTERS)) {
+    // <first-event last-event counters>
+    for (int i = 0; i + 3 <= prop->len / 4 && pmu_ncounters < PMU_MAX_MAPS; i += 3) {
+      pmu_counters[pmu_ncounters].first = fdt_cell(&value[i]);
+      pmu_counters[pmu_ncounters].last = fdt_cell(&value[i + 1]);
+      pmu_counters[pmu_ncounters++].counters = fdt_cell(&value[i + 2]);
+    }
+  } else if (fdt_prop_is(prop, FDT_PROP_PMU_RAW_COUNTERS)) {
+    // <select-hi select-lo mask-hi mask-lo counters>
+    for (int i = 0; i + 5 <= prop->len / 4 && pmu_nraw < PMU_MAX_MAPS; i += 5) {
+      pmu_raw[pmu_nraw].select = pmu_cells64(&value[i]);
+      pmu_raw[pmu_nraw].mask = pmu_cells64(&value[i + 2]);
+      pmu_raw[pmu_nraw++].counters = fdt_cell(&value[i + 4]);
+    }
+  }
+}
+
+static void pmu_done(const struct fdt_scan_node *node, void *extra)
+{
+  struct pmu_scan *scan = (struct pmu_scan *)extra;
+  if (scan->compat)
+    pmu_fdt = 1;
+}
+
+void query_pmu(uintptr_t fdt)
+{
+  struct fdt_cb cb;
+  struct pmu_scan scan;
+
+  memset(&cb, 0, sizeof(cb));
+  cb.open = pmu_open;
+  cb.prop = pmu_prop;
+  cb.done = pmu_done;
+  cb.extra = &scan;
+
+  fdt_scan_compatible(fdt, "riscv,pmu", &cb);
+}
+
+///////////////////////////////////////////// SBI CALLS /////////////////////////////////////////
+
+// The counters named by a mask relative to base, or 0 if any cannot exist
+static uint32_t pmu_counter_mask(uintptr_t base, uintptr_t mask)
+{
+  if (base >= PMU_COUNTERS)
+    return 0;
+  unsigned long counters = mask << base;
+  if (counters >> base != mask || counters != (uint32_t)counters)
+    return 0;
+  return counters;
+}
+
+long pmu_num_counters()
+{
+  uint32_t present = HLS()->pmu_present;
+  int n = 0;
+
+  while (n < PMU_COUNTERS && (present >> n))
+    n++;
+  return n;
+}
+
+long pmu_counter_info(uintptr_t counter, uintptr_t* info)
+{
+  if (counter >= PMU_COUNTERS || !((HLS()->pmu_present >> counter) & 1))
+    return SBI_ERR_INVALID_PARAM;
+
+  int width = (PMU_FIXED_COUNTERS >> counter) & 1 ? 64 : pmu_hpm_width;
+  *info = (CSR_CYCLE + counter) | ((width - 1) << 12);
+  return SBI_SUCCESS;
+}
+
+// The counters an event may use and the mhpmevent value that selects it
+static uint32_t pmu_event_counters(uintptr_t event, uint64_t data, uint64_t* mhpmevent)
+{
+  uint32_t hpm = ~7U; // 3-31
+  uint32_t counters = 0;
+
+  switch (SBI_PMU_EVENT_TYPE(event))
+  {
+    case SBI_PMU_EVENT_TYPE_HW:
+      if (event == SBI_PMU_HW_CPU_CYCLES)
+        counters |= 1U << 0;
+      if (event == SBI_PMU_HW_INSTRUCTIONS)
+        counters |= 1U << 2;
+      // fall through
+    case SBI_PMU_EVENT_TYPE_CACHE:
+      for (int i = 0; i < pmu_nevents; i++) {
+        if (pmu_events[i].event != event)
+          continue;
+        *mhpmevent = pmu_events[i].mhpmevent;
+        if (!pmu_ncounters)
+          return counters | hpm;
+        for (int j = 0; j < pmu_ncounters; j++)
+          if (pmu_counters[j].first <= event && event <= pmu_counters[j].last)
+            counters |= pmu_counters[j].counters & hpm;
+        break;
+      }
+      return counters;
+    case SBI_PMU_EVENT_TYPE_RAW:
+      *mhpmevent = data;
+      if (!pmu_nraw)
+        return hpm;
+      for (int i = 0; i < pmu_nraw; i++)
+        if ((data & pmu_raw[i].mask) == pmu_raw[i].select)
+          counters |= pmu_raw[i].counters & hpm;
+      return counters;
+  }
+  return 0;
+}
+
+// Privilege-mode filtering needs Sscofpmf; without it, the SET_*INH flags
+// are ignored
+static uint64_t pmu_event_filter(uintptr_t flags)
+{
+  uint64_t filter = 0;
+
+  if (!pmu_sscofpmf)
+    return 0;
+  if (flags & SBI_PMU_CFG_FLAG_SET_VUINH)
+    filter |= MHPMEVENT_VUINH;
+  if (flags & SBI_PMU_CFG_FLAG_SET_VSINH)
+    filter |= MHPMEVENT_VSINH;
+  if (flags & SBI_PMU_CFG_FLAG_SET_UINH)
+    filter |= MHPMEVENT_UINH;
+  if (flags & SBI_PMU_CFG_FLAG_SET_SINH)
+    filter |= MHPMEVENT_SINH;
+  if (flags & SBI_PMU_CFG_FLAG_SET_MINH)
+    filter |= MHPMEVENT_MINH;
+  return filter;
+}
+
+long pmu_config_matching(uintptr_t base, uintptr_t mask, uintptr_t flags,
+                         uintptr_t event, uint64_t data, uintptr_t* counter)
+{
+  hls_t* hls = HLS();
+  uint32_t candidates = pmu_counter_mask(base, mask) & hls->pmu_present;
+  uint64_t mhpmevent = 0;
+  int i;
+
+  if (flags & SBI_PMU_CFG_FLAG_SKIP_MATCH)
+    candidates &= hls->pmu_used;
+  else
+    candidates &= ~hls->pmu_used & pmu_event_counters(event, data, &mhpmevent);
+
+  for (i = 0; i < PMU_COUNTERS; i++)
+    if ((candidates >> i) & 1)
+      break;
+  if (i == PMU_COUNTERS)
+    return SBI_ERR_NOT_SUPPORTED;
+
+  set_csr(mcountinhibit, 1UL << i);
+  if (!(flags & SBI_PMU_CFG_FLAG_SKIP_MATCH) && !((PMU_FIXED_COUNTERS >> i) & 1))
+    pmu_write_event(i, (mhpmevent & ~PMU_EVENT_FLAGS) | pmu_event_filter(flags));
+  if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
+    pmu_write_counter(i, 0);
+  if (flags & SBI_PMU_CFG_FLAG_AUTO_START)
+    clear_csr(mcountinhibit, 1UL << i);
+
+  hls->pmu_used |= 1U << i;
+  *counter = i;
+  return SBI_SUCCESS;
+}
+
+long pmu_start(uintptr_t base, uintptr_t mask, uintptr_t flags, uint64_t value)
+{
+  uint32_t counters = pmu_counter_mask(base, mask);
+  uint32_t inhibit = read_csr(mcountinhibit);
+
+  if (!counters || (counters & ~HLS()->pmu_used))
+    return SBI_ERR_INVALID_PARAM;
+  if (counters & ~inhibit)
+    return SBI_ERR_ALREADY_STARTED;
+
+  for (int i = 0; i < PMU_COUNTERS; i++) {
+    if (!((counters >> i) & 1))
+      continue;
+    if (flags & SBI_PMU_START_FLAG_SET_INIT_VALUE)
+      pmu_write_counter(i, value);
+    // Rearm the overflow interrupt, which is raised as OF is set
+    if (pmu_sscofpmf && !((PMU_FIXED_COUNTERS >> i) & 1))
+      pmu_write_event(i, pmu_read_event(i) & ~MHPMEVENT_OF);
+  }
+  clear_csr(mcountinhibit, counters);
+  return SBI_SUCCESS;
+}
+
+long pmu_stop(uintptr_t base, uintptr_t mask, uintptr_t flags)
+{
+  hls_t* hls = HLS();
+  uint32_t counters = pmu_counter_mask(base, mask);
+  uint32_t inhibit = read_csr(mcountinhibit);
+
+  if (!counters || (counters & ~hls->pmu_used))
+    return SBI_ERR_INVALID_PARAM;
+  if (counters & inhibit)
+    return SBI_ERR_ALREADY_STOPPED;
+
+  set_csr(mcountinhibit, counters);
+  if (flags & SBI_PMU_STOP_FLAG_RESET) {
+    for (int i = 3; i < PMU_COUNTERS; i++)
+      if ((counters >> i) & 1)
+        pmu_write_event(i, 0);
+    hls->pmu_used &= ~counters;
+    // Released, cycle and instret go back to counting for rdcycle and rdinstret
+    clear_csr(mcountinhibit, counters & PMU_FIXED_COUNTERS);
+  }
+  return SBI_SUCCESS;
+}
+
+// S-mode can read the counters itself; this is for callers that cannot
+long pmu_read(uintptr_t counter, uint64_t* value)
+{
+  if (counter >= PMU_COUNTERS || !((HLS()->pmu_used >> counter) & 1))
+    return SBI_ERR_INVALID_PARAM;
+  *value = pmu_read_counter(counter);
+  return SBI_SUCCESS;
+}
+
+#ifdef PK_HPM_MUX
+///////////////////////////////////////////// MULTIPLEXER ///////////////////////////////////////
+
+static const struct {
+  uint64_t mhpmevent;
+  const char* name;
+} hpm_mux_events[] = {
+#define X(event, name) { event, name },
+  HPM_EVENT_LIST(X)
+#undef X
+};
+
+#define HPM_MUX_EVENTS (int)(sizeof(hpm_mux_events) / sizeof(hpm_mux_events[0]))
+
+// Each hart counts the events a group at a time, a group being as many
+// events as it has HPM counters, and moves on to the next group every
+// PK_HPM_MUX_PERIOD ticks of mtime.  Only the owning hart writes its state.
+struct hpm_mux {
+  uint64_t count[HPM_MUX_EVENTS];
+  uint64_t enabled[HPM_MUX_EVENTS]; // mtime ticks each event was counted for
+  uint64_t running; // mtime ticks since the multiplexer started
+  uint64_t start; // when the current group was installed
+  uint64_t next; // when the next group is due
+  uint64_t s_timecmp; // S-mode's timer, which shares mtimecmp
+  uint32_t counters;
+  int first; // the event on the lowest counter
+};
+
+static struct hpm_mux hpm_mux[MAX_HARTS];
+
+// Count the current group from zero
+static void hpm_mux_install(struct hpm_mux* m)
+{
+  int e = m->first, used = 0;
+
+  set_csr(mcountinhibit, m->counters);
+  for (int i = 3; i < PMU_COUNTERS; i++) {
+    if (!((m->counters >> i) & 1))
+      continue;
+    // Spare counters, when there are more than events, count nothing
+    pmu_write_event(i, used < HPM_MUX_EVENTS ? hpm_mux_events[e].mhpmevent : 0);
+    pmu_write_counter(i, 0);
+    if (used < HPM_MUX_EVENTS) {
+      used++;
+      if (++e == HPM_MUX_EVENTS)
+        e = 0;
+    }
+  }
+  m->start = *mtime;
+  clear_csr(mcountinhibit, m->counters);
+}
+
+// Add the current group's counts to the totals and move on to the next
+static void hpm_mux_bank(struct hpm_mux* m, uint64_t now)
+{
+  uint64_t ticks = now - m->start;
+  int e = m->first, used = 0;
+
+  set_csr(mcountinhibit, m->counters);
+  for (int i = 3; i < PMU_COUNTERS && used < HPM_MUX_EVENTS; i++) {
+    if (!((m->counters >> i) & 1))
+      continue;
+    m->count[e] += pmu_read_counter(i);
+    m->enabled[e] += ticks;
+    used++;
+    if (++e == HPM_MUX_EVENTS)
+      e = 0;
+  }
+  m->running += ticks;
+  m->first = e;
+}
+
+// mtimecmp fires for whichever of the rotation and S-mode's timer is first
+static void hpm_mux_arm(struct hpm_mux* m)
+{
+  *HLS()->timecmp = m->next < m->s_timecmp ? m->next : m->s_timecmp;
+  set_csr(mie, MIP_MTIP);
+}
+
+void hpm_mux_start(uint32_t counters)
+{
+  struct hpm_mux* m = &hpm_mux[read_csr(mhartid)];
+
+  memset(m, 0, sizeof(*m));
+  m->counters = counters;
+  m->s_timecmp = -1ULL;
+  m->next = -1ULL;
+  if (!counters)
+    return;
+
+  hpm_mux_install(m);
+  m->next = m->start + PK_HPM_MUX_PERIOD;
+  hpm_mux_arm(m);
+}
+
+void hpm_mux_trap(uintptr_t* regs, uintptr_t dummy, uintptr_t mepc)
+{
+  struct hpm_mux* m = &hpm_mux[read_csr(mhartid)];
+  uint64_t now = *mtime;
+
+  if (now >= m->s_timecmp) {
+    m->s_timecmp = -1ULL;
+    set_csr(mip, MIP_STIP);
+  }
+  if (now >= m->next) {
+    hpm_mux_bank(m, now);
+    hpm_mux_install(m);
+    m->next = m->start + PK_HPM_MUX_PERIOD;
+  }
+  hpm_mux_arm(m);
+}
+
+void hpm_mux_set_timer(uint64_t when)
+{
+  struct hpm_mux* m = &hpm_mux[read_csr(mhartid)];
+
+  m->s_timecmp = when;
+  hpm_mux_arm(m);
+}
+
+int hpm_mux_num_events()
+{
+  return HPM_MUX_EVENTS;
+}
+
+long hpm_mux_event(uintptr_t event, uintptr_t* mhpmevent)
+{
+  if (event >= HPM_MUX_EVENTS)
+    return SBI_ERR_INVALID_PARAM;
+  *mhpmevent = hpm_mux_events[event].mhpmevent;
+  return SBI_SUCCESS;
+}
+
+// Another hart's totals are as of its last rotation
+long hpm_mux_read(uintptr_t hart, uintptr_t event, uint64_t* count, uint64_t* enabled)
+{
+  if (hart >= MAX_HARTS || event >= HPM_MUX_EVENTS)
+    return SBI_ERR_INVALID_PARAM;
+  *count = hpm_mux[hart].count[event];
+  *enabled = hpm_mux[hart].enabled[event];
+  return SBI_SUCCESS;
+}
+
+uint64_t hpm_mux_running(uintptr_t hart)
+{
+  return hart < MAX_HARTS ? hpm_mux[hart].running : 0;
+}
+
+// RV32 has no 64-bit divide, and there is no libgcc to provide one
+static uint64_t hpm_mux_divide(uint64_t n, uint64_t d, uint64_t* rem)
+{
+  uint64_t q = 0, r = 0;
+
+  for (int i = 0; i < 64; i++) {
+    r = (r << 1) | (n >> 63);
+    n <<= 1;
+    q <<= 1;
+    if (r >= d) {
+      r -= d;
+      q |= 1;
+    }
+  }
+  *rem = r;
+  return q;
+}
+
+// count * running / enabled, the count had the event been counted throughout.
+// Narrowing running to 32 bits keeps rem * running from overflowing.
+static uint64_t hpm_mux_scale(uint64_t count, uint64_t enabled, uint64_t running)
+{
+  uint64_t q, rem;
+
+  while (running >> 32) {
+    running >>= 1;
+    enabled >>= 1;
+  }
+  if (!enabled)
+    return count;
+  q = hpm_mux_divide(count, enabled, &rem);
+  return q * running + hpm_mux_divide(rem * running, enabled, &rem);
+}
+
+void hpm_mux_print()
+{
+  struct hpm_mux* self = &hpm_mux[read_csr(mhartid)];
+
+  // Include the group this hart is part way through
+  if (self->counters) {
+    hpm_mux_bank(self, *mtime);
+    hpm_mux_install(self);
+  }
+
+  for_each_hart(hart, &hart_mask) {
+    struct hpm_mux* m = &hpm_mux[hart];
+    if (!m->running)
+      continue;
+    printm("hpm mux hart %d: %lld ticks\r\n", (int)hart, (long long)m->running);
+    for (int i = 0; i < HPM_MUX_EVENTS; i++) {
+      if (!m->enabled[i])
+        continue;
+      printm("  %s: %lld in %lld ticks, ~%lld\r\n", hpm_mux_events[i].name,
+             (long long)m->count[i], (long long)m->enabled[i],
+             (long long)hpm_mux_scale(m->count[i], m->enabled[i], m->running));
+    }
+    mlog_flush();
+  }
+}
+
+#else
+
+void hpm_mux_print()
+{
+}
+
+#endif
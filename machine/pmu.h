@@ -0,0 +1,37 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_PMU_H
+#define _RISCV_PMU_H
+
+#include <stdint.h>
+
+// Counters are numbered as their CSRs: 0 is cycle, 2 instret and 3-31
+// the HPM counters.  Time cannot be stopped, so is never a counter here.
+#define PMU_COUNTERS 32
+#define PMU_FIXED_COUNTERS 0x5 // cycle and instret
+
+// Read the riscv,pmu node, as OpenSBI does, and set up this hart
+void query_pmu(uintptr_t fdt);
+void hart_pmu_init();
+
+// The SBI PMU calls; each returns an SBI error code
+long pmu_num_counters();
+long pmu_counter_info(uintptr_t counter, uintptr_t* info);
+long pmu_config_matching(uintptr_t base, uintptr_t mask, uintptr_t flags,
+                         uintptr_t event, uint64_t data, uintptr_t* counter);
+long pmu_start(uintptr_t base, uintptr_t mask, uintptr_t flags, uint64_t value);
+long pmu_stop(uintptr_t base, uintptr_t mask, uintptr_t flags);
+long pmu_read(uintptr_t counter, uint64_t* value);
+
+// With --enable-hpm-mux, every event in hpm_events.h is counted, a group
+// at a time, on the HPM counters, which S-mode no longer sees
+void hpm_mux_start(uint32_t counters);
+void hpm_mux_trap(uintptr_t* regs, uintptr_t dummy, uintptr_t mepc);
+void hpm_mux_set_timer(uint64_t when);
+int hpm_mux_num_events();
+long hpm_mux_event(uintptr_t event, uintptr_t* mhpmevent);
+long hpm_mux_read(uintptr_t hart, uintptr_t event, uint64_t* count, uint64_t* enabled);
+uint64_t hpm_mux_running(uintptr_t hart);
+void hpm_mux_print();
+
+#endif
@@ -0,0 +1,380 @@
+// See LICENSE for license details.
+
+#include "mcall.h"
+#include "mtrap.h"
+#include "mconsole.h"
+#include "mstats.h"
+#include "pmu.h"
+#include "fdt.h"
+#include "string.h"
+
+struct sbiret {
+  long error;
+  long value;
+};
+
+static long sbi_probe(uintptr_t ext)
+{
+  switch (ext)
+  {
+    case SBI_SET_TIMER:
+    case SBI_CONSOLE_PUTCHAR:
+    case SBI_CONSOLE_GETCHAR:
+    case SBI_CLEAR_IPI:
+    case SBI_SEND_IPI:
+    case SBI_REMOTE_FENCE_I:
+    case SBI_REMOTE_SFENCE_VMA:
+    case SBI_REMOTE_SFENCE_VMA_ASID:
+    case SBI_SHUTDOWN:
+    case SBI_EXT_BASE:
+    case SBI_EXT_TIME:
+    case SBI_EXT_IPI:
+    case SBI_EXT_RFENCE:
+    case SBI_EXT_DBCN:
+    case SBI_EXT_PMU:
+#if defined(PK_ENABLE_MSTATS) || defined(PK_HPM_MUX)
+    case SBI_EXT_MSTATS:
+#endif
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static struct sbiret sbi_base(uintptr_t fid, uintptr_t* regs)
+{
+  struct sbiret ret = { SBI_SUCCESS, 0 };
+
+  switch (fid)
+  {
+    case SBI_EXT_BASE_GET_SPEC_VERSION:
+      ret.value = SBI_SPEC_VERSION;
+      break;
+    case SBI_EXT_BASE_GET_IMP_ID:
+      ret.value = SBI_IMPL_ID;
+      break;
+    case SBI_EXT_BASE_GET_IMP_VERSION:
+      ret.value = SBI_IMPL_VERSION;
+      break;
+    case SBI_EXT_BASE_PROBE_EXT:
+      ret.value = sbi_probe(regs[10]);
+      break;
+    case SBI_EXT_BASE_GET_MVENDORID:
+      ret.value = read_csr(mvendorid);
+      break;
+    case SBI_EXT_BASE_GET_MARCHID:
+      ret.value = read_csr(marchid);
+      break;
+    case SBI_EXT_BASE_GET_MIMPID:
+      ret.value = read_csr(mimpid);
+      break;
+    default:
+      ret.error = SBI_ERR_NOT_SUPPORTED;
+      break;
+  }
+  return ret;
+}
+
+static struct sbiret sbi_time(uintptr_t fid, uintptr_t* regs)
+{
+  struct sbiret ret = { SBI_SUCCESS, 0 };
+
+  switch (fid)
+  {
+    case SBI_EXT_TIME_SET_TIMER:
+#if __riscv_xlen == 32
+      mcall_set_timer(regs[10] + ((uint64_t)regs[11] << 32));
+#else
+      mcall_set_timer(regs[10]);
+#endif
+      break;
+    default:
+      ret.error = SBI_ERR_NOT_SUPPORTED;
+      break;
+  }
+  return ret;
+}
+
+// Harts are selected by a mask relative to a base, or by a base of -1 for all
+static long sbi_hart_mask(uintptr_t mask, uintptr_t base, hart_mask_t* harts)
+{
+  if (base == (uintptr_t)-1) {
+    *harts = hart_mask;
+    return SBI_SUCCESS;
+  }
+
+  memset(harts, 0, sizeof(*harts));
+  for (uintptr_t hart = base; mask; hart++, mask >>= 1) {
+    if (!(mask & 1))
+      continue;
+    if (hart < base || !hart_mask_test(&hart_mask, hart))
+      return SBI_ERR_INVALID_PARAM;
+    hart_mask_set(harts, hart);
+  }
+  return SBI_SUCCESS;
+}
+
+static struct sbiret sbi_ipi(uintptr_t fid, uintptr_t* regs)
+{
+  struct sbiret ret = { SBI_SUCCESS, 0 };
+  hart_mask_t harts;
+
+  switch (fid)
+  {
+    case SBI_EXT_IPI_SEND_IPI:
+      if ((ret.error = sbi_hart_mask(regs[10], regs[11], &harts)))
+        break;
+#ifndef BBL_GFE
+      send_ipi_many(&harts, IPI_SOFT);
+#endif
+      break;
+    default:
+      ret.error = SBI_ERR_NOT_SUPPORTED;
+      break;
+  }
+  return ret;
+}
+
+// The hypervisor fences are not supported, as there is no H extension
+static struct sbiret sbi_rfence(uintptr_t fid, uintptr_t* regs)
+{
+  struct sbiret ret = { SBI_SUCCESS, 0 };
+  hart_mask_t harts;
+
+  if (fid > SBI_EXT_RFENCE_REMOTE_SFENCE_VMA_ASID) {
+    ret.error = SBI_ERR_NOT_SUPPORTED;
+    return ret;
+  }
+  if ((ret.error = sbi_hart_mask(regs[10], regs[11], &harts)))
+    return ret;
+
+#ifndef BBL_GFE
+  switch (fid)
+  {
+    case SBI_EXT_RFENCE_REMOTE_FENCE_I:
+      remote_fence_i(&harts);
+      break;
+    case SBI_EXT_RFENCE_REMOTE_SFENCE_VMA:
+      remote_sfence_vma(&harts, regs[12], regs[13], SFENCE_ASID_ALL);
+      break;
+    case SBI_EXT_RFENCE_REMOTE_SFENCE_VMA_ASID:
+      remote_sfence_vma(&harts, regs[12], regs[13], regs[14]);
+      break;
+  }
+#endif
+  return ret;
+}
+
+// Console buffers are physical addresses, which must be in RAM and outside bbl
+static uint8_t* sbi_dbcn_buffer(uintptr_t len, uintptr_t base_lo, uintptr_t base_hi)
+{
+  extern char _ftext, _end;
+  uintptr_t offset = base_lo - MEM_START;
+
+  if (base_hi || base_lo < MEM_START || offset > mem_size || len > mem_size - offset)
+    return NULL;
+  if (base_lo < (uintptr_t)&_end && base_lo + len > (uintptr_t)&_ftext)
+    return NULL;
+  return ptr_to_ddccap((uint8_t*)base_lo);
+}
+
+static struct sbiret sbi_dbcn(uintptr_t fid, uintptr_t* regs)
+{
+  struct sbiret ret = { SBI_SUCCESS, 0 };
+  uintptr_t len = regs[10];
+  uint8_t* buf;
+
+  switch (fid)
+  {
+    case SBI_EXT_DBCN_CONSOLE_WRITE:
+      if (!(buf = sbi_dbcn_buffer(len, regs[11], regs[12]))) {
+        ret.error = SBI_ERR_INVALID_PARAM;
+        break;
+      }
+      console_write(buf, len);
+      ret.value = len;
+      break;
+    case SBI_EXT_DBCN_CONSOLE_READ:
+      if (!(buf = sbi_dbcn_buffer(len, regs[11], regs[12]))) {
+        ret.error = SBI_ERR_INVALID_PARAM;
+        break;
+      }
+      ret.value = console_read(buf, len);
+      break;
+    case SBI_EXT_DBCN_CONSOLE_WRITE_BYTE:
+      console_putchar(regs[10]);
+      break;
+    default:
+      ret.error = SBI_ERR_NOT_SUPPORTED;
+      break;
+  }
+  return ret;
+}
+
+// 64-bit arguments take two registers on RV32, low half first
+#if __riscv_xlen == 32
+# define SBI_ARG64(regs, i) ((regs)[i] + ((uint64_t)(regs)[(i) + 1] << 32))
+#else
+# define SBI_ARG64(regs, i) ((uint64_t)(regs)[i])
+#endif
+
+static struct sbiret sbi_pmu(uintptr_t fid, uintptr_t* regs)
+{
+  struct sbiret ret = { SBI_SUCCESS, 0 };
+  uintptr_t value = 0;
+  uint64_t count = 0;
+
+  switch (fid)
+  {
+    case SBI_EXT_PMU_NUM_COUNTERS:
+      ret.value = pmu_num_counters();
+      break;
+    case SBI_EXT_PMU_COUNTER_GET_INFO:
+      ret.error = pmu_counter_info(regs[10], &value);
+      ret.value = value;
+      break;
+    case SBI_EXT_PMU_COUNTER_CONFIG_MATCHING:
+      ret.error = pmu_config_matching(regs[10], regs[11], regs[12], regs[13],
+                                      SBI_ARG64(regs, 14), &value);
+      ret.value = value;
+      break;
+    case SBI_EXT_PMU_COUNTER_START:
+      ret.error = pmu_start(regs[10], regs[11], regs[12], SBI_ARG64(regs, 13));
+      break;
+    case SBI_EXT_PMU_COUNTER_STOP:
+      ret.error = pmu_stop(regs[10], regs[11], regs[12]);
+      break;
+    case SBI_EXT_PMU_COUNTER_FW_READ:
+      ret.error = pmu_read(regs[10], &count);
+      ret.value = count;
+      break;
+    case SBI_EXT_PMU_COUNTER_FW_READ_HI:
+      ret.error = pmu_read(regs[10], &count);
+#if __riscv_xlen == 32
+      ret.value = count >> 32;
+#endif
+      break;
+    default:
+      ret.error = SBI_ERR_NOT_SUPPORTED;
+      break;
+  }
+  return ret;
+}
+
+#if defined(PK_ENABLE_MSTATS) || defined(PK_HPM_MUX)
+static struct sbiret sbi_mstats(uintptr_t fid, uintptr_t* regs)
+{
+  struct sbiret ret = { SBI_SUCCESS, 0 };
+  uintptr_t hart = regs[10], counter = regs[11], word = regs[12];
+  uint64_t val, enabled;
+
+  switch (fid)
+  {
+#ifdef PK_ENABLE_MSTATS
+    case SBI_EXT_MSTATS_NUM_COUNTERS:
+      ret.value = MSTATS_NUM;
+      break;
+    case SBI_EXT_MSTATS_READ:
+    case SBI_EXT_MSTATS_READ_CYCLES:
+      if (!hart_mask_test(&hart_mask, hart) || counter >= MSTATS_NUM ||
+          word >= sizeof(uint64_t) / sizeof(uintptr_t)) {
+        ret.error = SBI_ERR_INVALID_PARAM;
+        break;
+      }
+#ifdef PK_MSTATS_CYCLES
+      val = fid == SBI_EXT_MSTATS_READ ? mstats[hart].count[counter] : mstats[hart].cycles[counter];
+#else
+      if (fid == SBI_EXT_MSTATS_READ_CYCLES) {
+        ret.error = SBI_ERR_NOT_SUPPORTED;
+        break;
+      }
+      val = mstats[hart].count[counter];
+#endif
+      ret.value = word ? val >> 32 : val;
+      break;
+    case SBI_EXT_MSTATS_RESET: {
+      hart_mask_t harts;
+      if ((ret.error = sbi_hart_mask(regs[10], regs[11], &harts)))
+        break;
+      for_each_hart(h, &harts)
+        mstats_reset(h);
+      break;
+    }
+#endif
+#ifdef PK_HPM_MUX
+    case SBI_EXT_MSTATS_MUX_NUM_EVENTS:
+      ret.value = hpm_mux_num_events();
+      break;
+    case SBI_EXT_MSTATS_MUX_EVENT: {
+      uintptr_t mhpmevent = 0;
+      ret.error = hpm_mux_event(regs[10], &mhpmevent);
+      ret.value = mhpmevent;
+      break;
+    }
+    case SBI_EXT_MSTATS_MUX_READ:
+    case SBI_EXT_MSTATS_MUX_READ_ENABLED:
+      if (!hart_mask_test(&hart_mask, hart) || word >= sizeof(uint64_t) / sizeof(uintptr_t) ||
+          hpm_mux_read(hart, counter, &val, &enabled)) {
+        ret.error = SBI_ERR_INVALID_PARAM;
+        break;
+      }
+      if (fid == SBI_EXT_MSTATS_MUX_READ_ENABLED)
+        val = enabled;
+      ret.value = word ? val >> 32 : val;
+      break;
+    case SBI_EXT_MSTATS_MUX_READ_RUNNING:
+      if (!hart_mask_test(&hart_mask, hart) || regs[11] >= sizeof(uint64_t) / sizeof(uintptr_t)) {
+        ret.error = SBI_ERR_INVALID_PARAM;
+        break;
+      }
+      val = hpm_mux_running(hart);
+      ret.value = regs[11] ? val >> 32 : val;
+      break;
+#endif
+    default:
+      ret.error = SBI_ERR_NOT_SUPPORTED;
+      break;
+  }
+  return ret;
+}
+#endif
+
+void sbi_ecall(uintptr_t* regs, uintptr_t mepc)
+{
+  uintptr_t ext = regs[17], fid = regs[16];
+  struct sbiret ret;
+
+  switch (ext)
+  {
+    case SBI_EXT_BASE:
+      ret = sbi_base(fid, regs);
+      break;
+    case SBI_EXT_TIME:
+      ret = sbi_time(fid, regs);
+      break;
+    case SBI_EXT_IPI:
+      ret = sbi_ipi(fid, regs);
+      break;
+    case SBI_EXT_RFENCE:
+      ret = sbi_rfence(fid, regs);
+      break;
+    case SBI_EXT_DBCN:
+      ret = sbi_dbcn(fid, regs);
+      break;
+    case SBI_EXT_PMU:
+      ret = sbi_pmu(fid, regs);
+      break;
+#if defined(PK_ENABLE_MSTATS) || defined(PK_HPM_MUX)
+    case SBI_EXT_MSTATS:
+      ret = sbi_mstats(fid, regs);
+      break;
+#endif
+    default:
+      ret.error = SBI_ERR_NOT_SUPPORTED;
+      ret.value = 0;
+      break;
+  }
+
+  regs[10] = ret.error;
+  regs[11] = ret.value;
+}
@@ -6,26 +6,45 @@
 #include "fdt.h"
 
 volatile uint32_t* uart;
+uint32_t uart_irq;
 
-void uart_putchar(uint8_t ch)
+// Fill the transmit FIFO from buf until it is full
+size_t uart_write(const uint8_t *buf, size_t len)
 {
+  size_t n = 0;
 #ifdef __riscv_atomic
+  // amoor only enqueues if the FIFO has room, and returns the full flag
+  for (; n < len; n++) {
     int32_t r;
-    do {
-      __asm__ __volatile__ (
+    __asm__ __volatile__ (
 #if __has_feature(capabilities)
-        "camoor.w %0, %2, %1\n"
+      "camoor.w %0, %2, %1\n"
 #else
-        "amoor.w %0, %2, %1\n"
+      "amoor.w %0, %2, %1\n"
 #endif
-        : "=r" (r), "+A" (uart[UART_REG_TXFIFO])
-        : "r" (ch));
-    } while (r < 0);
+      : "=r" (r), "+A" (uart[UART_REG_TXFIFO])
+      : "r" (buf[n]));
+    if (r < 0)
+      break;
+  }
 #else
-    volatile uint32_t *tx = uart + UART_REG_TXFIFO;
-    while ((int32_t)(*tx) < 0);
-    *tx = ch;
+  volatile uint32_t *tx = uart + UART_REG_TXFIFO;
+  while (n < len && (int32_t)(*tx) >= 0)
+    *tx = buf[n++];
 #endif
+  return n;
+}
+
+void uart_putchar(uint8_t ch)
+{
+  while (!uart_write(&ch, 1));
+}
+
+// Interrupt on any received character, and on an empty transmit FIFO if tx
+void uart_irq_enable(int tx)
+{
+  uart[UART_REG_TXCTRL] = UART_TXEN | UART_TXCNT(1);
+  uart[UART_REG_IE] = UART_IP_RXWM | (tx ? UART_IP_TXWM : 0);
 }
 
 int uart_getchar()
@@ -39,6 +58,7 @@ struct uart_scan
 {
   int compat;
   uint64_t reg;
+  uint32_t irq;
 };
 
 static void uart_open(const struct fdt_scan_node *node, void *extra)
@@ -50,22 +70,30 @@ static void uart_open(const struct fdt_scan_node *node, void *extra)
 static void uart_prop(const struct fdt_scan_prop *prop, void *extra)
 {
   struct uart_scan *scan = (struct uart_scan *)extra;
-  if (!strcmp(prop->name, "compatible") && fdt_string_list_index(prop, "sifive,uart0") >= 0) {
+  if (fdt_prop_is(prop, FDT_PROP_COMPATIBLE) && fdt_string_list_index(prop, "sifive,uart0") >= 0) {
     scan->compat = 1;
-  } else if (!strcmp(prop->name, "reg")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_REG)) {
     fdt_get_address(prop->node->parent, prop->value, &scan->reg);
+  } else if (fdt_prop_is(prop, FDT_PROP_INTERRUPTS)) {
+    scan->irq = fdt_get_value(prop, 0);
   }
 }
 
+void uart_init(uintptr_t base)
+{
+  // Enable Rx/Tx channels
+  uart = ptr_to_ddccap((void*)base);
+  uart[UART_REG_TXCTRL] = UART_TXEN;
+  uart[UART_REG_RXCTRL] = UART_RXEN;
+}
+
 static void uart_done(const struct fdt_scan_node *node, void *extra)
 {
   struct uart_scan *scan = (struct uart_scan *)extra;
   if (!scan->compat || !scan->reg || uart) return;
 
-  // Enable Rx/Tx channels
-  uart = ptr_to_ddccap((void*)(uintptr_t)scan->reg);
-  uart[UART_REG_TXCTRL] = UART_TXEN;
-  uart[UART_REG_RXCTRL] = UART_RXEN;
+  uart_init(scan->reg);
+  uart_irq = scan->irq;
 }
 
 void query_uart(uintptr_t fdt)
@@ -79,5 +107,5 @@ void query_uart(uintptr_t fdt)
   cb.done = uart_done;
   cb.extra = &scan;
 
-  fdt_scan(fdt, &cb);
+  fdt_scan_compatible(fdt, "sifive,uart0", &cb);
 }
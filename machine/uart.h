@@ -3,21 +3,32 @@
 #ifndef _RISCV_UART_H
 #define _RISCV_UART_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 extern volatile uint32_t* uart;
+extern uint32_t uart_irq;
 
 #define UART_REG_TXFIFO		0
 #define UART_REG_RXFIFO		1
 #define UART_REG_TXCTRL		2
 #define UART_REG_RXCTRL		3
-#define UART_REG_DIV		4
+#define UART_REG_IE		4
+#define UART_REG_IP		5
+#define UART_REG_DIV		6
 
 #define UART_TXEN		 0x1
 #define UART_RXEN		 0x1
+#define UART_TXCNT(n)		 ((n) << 16)
+
+#define UART_IP_TXWM		 0x1
+#define UART_IP_RXWM		 0x2
 
 void uart_putchar(uint8_t ch);
 int uart_getchar();
+size_t uart_write(const uint8_t *buf, size_t len);
+void uart_irq_enable(int tx);
+void uart_init(uintptr_t base);
 void query_uart(uintptr_t dtb);
 
 #endif
@@ -3,6 +3,9 @@
 #include "uart16550.h"
 #include "encoding.h"
 #include "fdt.h"
+#ifdef PK_STATIC_PLATFORM
+#include "platform_profile.h"
+#endif
 
 #ifndef BBL_GFE
 volatile uint8_t* uart16550;
@@ -11,8 +14,15 @@ volatile uint32_t* uart16550 = 0;
 #endif
 // some devices require a shifted register index
 // (e.g. 32 bit registers instead of 8 bit registers)
+#if defined(BBL_GFE)
+# define uart16550_reg_shift 0
+#elif defined(PLATFORM_UART16550_REG_SHIFT)
+# define uart16550_reg_shift PLATFORM_UART16550_REG_SHIFT
+#else
 static uint32_t uart16550_reg_shift;
+#endif
 static uint32_t uart16550_clock = 1843200;   // a "common" base clock
+uint32_t uart16550_irq;
 
 #define UART_REG_QUEUE     0    // rx/tx fifo data
 #define UART_REG_DLL       0    // divisor latch (LSB)
@@ -26,6 +36,9 @@ static uint32_t uart16550_clock = 1843200;   // a "common" base clock
 #define UART_REG_SCR       7    // scratch register
 #define UART_REG_STATUS_RX 0x01
 #define UART_REG_STATUS_TX 0x20
+#define UART_REG_IER_RX    0x01    // received data available
+#define UART_REG_IER_TX    0x02    // transmit holding register empty
+#define UART_FIFO_DEPTH    16
 
 // We cannot use the word DEFAULT for a parameter that cannot be overridden due to -Werror
 #ifndef UART_DEFAULT_BAUD
@@ -38,6 +51,23 @@ void uart16550_putchar(uint8_t ch)
   uart16550[UART_REG_QUEUE << uart16550_reg_shift] = ch;
 }
 
+// An empty transmit FIFO takes its whole depth without further checks
+size_t uart16550_write(const uint8_t *buf, size_t len)
+{
+  if ((uart16550[UART_REG_LSR << uart16550_reg_shift] & UART_REG_STATUS_TX) == 0)
+    return 0;
+  if (len > UART_FIFO_DEPTH)
+    len = UART_FIFO_DEPTH;
+  for (size_t i = 0; i < len; i++)
+    uart16550[UART_REG_QUEUE << uart16550_reg_shift] = buf[i];
+  return len;
+}
+
+void uart16550_irq_enable(int tx)
+{
+  uart16550[UART_REG_IER << uart16550_reg_shift] = UART_REG_IER_RX | (tx ? UART_REG_IER_TX : 0);
+}
+
 int uart16550_getchar()
 {
   if (uart16550[UART_REG_LSR << uart16550_reg_shift] & UART_REG_STATUS_RX)
@@ -47,18 +77,23 @@ int uart16550_getchar()
 
 struct uart16550_scan
 {
+  uintptr_t fdt;
   int compat;
   uint64_t reg;
   uint32_t reg_offset;
   uint32_t reg_shift;
   uint32_t clock_freq;
+  uint32_t clock_phandle;
   uint32_t baud;
+  uint32_t irq;
 };
 
 static void uart16550_open(const struct fdt_scan_node *node, void *extra)
 {
   struct uart16550_scan *scan = (struct uart16550_scan *)extra;
+  uintptr_t fdt = scan->fdt;
   memset(scan, 0, sizeof(*scan));
+  scan->fdt = fdt;
   scan->baud = UART_DEFAULT_BAUD;
 }
 
@@ -66,42 +101,41 @@ static void uart16550_prop(const struct fdt_scan_prop *prop, void *extra)
 {
   struct uart16550_scan *scan = (struct uart16550_scan *)extra;
   // For the purposes of the boot loader, the 16750 is a superset of what 16550a provides
-  if (!strcmp(prop->name, "compatible") && ((fdt_string_list_index(prop, "ns16550a") != -1) || (fdt_string_list_index(prop, "ns16750") != -1))) {
+  if (fdt_prop_is(prop, FDT_PROP_COMPATIBLE) && ((fdt_string_list_index(prop, "ns16550a") != -1) || (fdt_string_list_index(prop, "ns16750") != -1))) {
     scan->compat = 1;
-  } else if (!strcmp(prop->name, "reg")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_REG)) {
     fdt_get_address(prop->node->parent, prop->value, &scan->reg);
-  } else if (!strcmp(prop->name, "reg-shift")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_REG_SHIFT)) {
     scan->reg_shift = fdt_get_value(prop, 0);
-  } else if (!strcmp(prop->name, "reg-offset")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_REG_OFFSET)) {
     scan->reg_offset = fdt_get_value(prop, 0);
-  } else if (!strcmp(prop->name, "current-speed")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_CURRENT_SPEED)) {
     // This is the property that Linux uses
     scan->baud = fdt_get_value(prop, 0);
-  } else if (!strcmp(prop->name, "clock-frequency")) {
+  } else if (fdt_prop_is(prop, FDT_PROP_CLOCK_FREQUENCY)) {
     scan->clock_freq = fdt_get_value(prop, 0);
+  } else if (fdt_prop_is(prop, FDT_PROP_CLOCKS)) {
+    scan->clock_phandle = fdt_get_value(prop, 0);
+  } else if (fdt_prop_is(prop, FDT_PROP_INTERRUPTS)) {
+    scan->irq = fdt_get_value(prop, 0);
   }
 }
 
-static void uart16550_done(const struct fdt_scan_node *node, void *extra)
+void uart16550_init(uintptr_t base, uint32_t reg_shift, uint32_t clock_freq, uint32_t baud)
 {
-  uint32_t clock_freq;
-  struct uart16550_scan *scan = (struct uart16550_scan *)extra;
-  if (!scan->compat || !scan->reg || uart16550) return;
-
-  if (scan->clock_freq != 0)
-    uart16550_clock = scan->clock_freq;
+  if (clock_freq != 0)
+    uart16550_clock = clock_freq;
   // if device tree doesn't supply a clock, fallback to default clock of 1843200
 
   // Check for divide by zero
-  uint32_t divisor = uart16550_clock / (16 * (scan->baud ? scan->baud : UART_DEFAULT_BAUD));
+  uint32_t divisor = uart16550_clock / (16 * (baud ? baud : UART_DEFAULT_BAUD));
   // If the divisor is out of range, don't assert, set the rate back to the default
   if (divisor >= 0x10000u)
     divisor = uart16550_clock / (16 * UART_DEFAULT_BAUD);
 
-  uart16550 = ptr_to_ddccap((void*)((uintptr_t)scan->reg + scan->reg_offset));
-  uart16550_reg_shift = scan->reg_shift;
-#ifdef BBL_GFE
-  uart16550_reg_shift = 0;
+  uart16550 = ptr_to_ddccap((void*)base);
+#if !defined(BBL_GFE) && !defined(PLATFORM_UART16550_REG_SHIFT)
+  uart16550_reg_shift = reg_shift;
 #endif
   // http://wiki.osdev.org/Serial_Ports
   uart16550[UART_REG_IER << uart16550_reg_shift] = 0x00;                // Disable all interrupts
@@ -110,7 +144,23 @@ static void uart16550_done(const struct fdt_scan_node *node, void *extra)
   uart16550[UART_REG_DLM << uart16550_reg_shift] = (uint8_t)(divisor >> 8);     //     (hi byte)
   uart16550[UART_REG_LCR << uart16550_reg_shift] = 0x03;                // 8 bits, no parity, one stop bit
   uart16550[UART_REG_FCR << uart16550_reg_shift] = 0xC7;                // Enable FIFO, clear them, with 14-byte threshold
+}
+
+static void uart16550_done(const struct fdt_scan_node *node, void *extra)
+{
+  struct uart16550_scan *scan = (struct uart16550_scan *)extra;
+  if (!scan->compat || !scan->reg || uart16550) return;
+
+  // Without a clock-frequency, take the rate of the clock it points at
+  if (scan->clock_freq == 0 && scan->clock_phandle != 0) {
+    int clock = fdt_node_by_phandle(scan->fdt, scan->clock_phandle);
+    const uint32_t *freq = fdt_node_prop(scan->fdt, clock, FDT_PROP_CLOCK_FREQUENCY, NULL);
+    if (freq)
+      scan->clock_freq = fdt_cell(freq);
+  }
 
+  uart16550_init(scan->reg + scan->reg_offset, scan->reg_shift, scan->clock_freq, scan->baud);
+  uart16550_irq = scan->irq;
 }
 
 void query_uart16550(uintptr_t fdt)
@@ -124,5 +174,8 @@ void query_uart16550(uintptr_t fdt)
   cb.done = uart16550_done;
   cb.extra = &scan;
 
-  fdt_scan(fdt, &cb);
+  scan.fdt = fdt;
+  fdt_scan_compatible(fdt, "ns16550a", &cb);
+  if (!uart16550)
+    fdt_scan_compatible(fdt, "ns16750", &cb);
 }
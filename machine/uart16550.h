@@ -3,6 +3,7 @@
 #ifndef _RISCV_16550_H
 #define _RISCV_16550_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef BBL_GFE
@@ -10,9 +11,13 @@ extern volatile uint8_t* uart16550;
 #else
 extern volatile uint32_t* uart16550;
 #endif
+extern uint32_t uart16550_irq;
 
 void uart16550_putchar(uint8_t ch);
 int uart16550_getchar();
+size_t uart16550_write(const uint8_t *buf, size_t len);
+void uart16550_irq_enable(int tx);
+void uart16550_init(uintptr_t base, uint32_t reg_shift, uint32_t clock_freq, uint32_t baud);
 void query_uart16550(uintptr_t dtb);
 
 #endif
@@ -123,6 +123,89 @@ static inline void store_uint64_t(uint64_t* addr, uint64_t val, uintptr_t mepc)
   store_uint32_t((uint32_t*)addr + 1, val >> 32, mepc);
 }
 #endif
+
+/*
+ * Misaligned accesses of at most a register's width, within one page,
+ * each done in a single MPRV window.  A load reads the one or two
+ * aligned words it touches and merges them.  A store must not write
+ * bytes outside the access, so it is split into naturally aligned
+ * pieces.
+ */
+static inline uintptr_t load_misaligned(uintptr_t addr, int len, uintptr_t mepc)
+{
+  register uintptr_t __mstatus_adjust asm ("a1") = MSTATUS_MPRV;
+  register uintptr_t __mepc asm ("a2") = mepc;
+  register uintptr_t __mstatus asm ("a3");
+  uintptr_t base = addr & -sizeof(uintptr_t), lo, hi;
+  unsigned shift = 8 * (addr - base);
+
+  if (addr + len - base <= sizeof(uintptr_t)) {
+    asm ("csrrs %[mstatus], mstatus, %[mprv]\n"
+         STR(LOAD) " %[lo], 0(%[base])\n"
+         "csrw mstatus, %[mstatus]"
+         : [mstatus] "+&r" (__mstatus), [lo] "=&r" (lo)
+         : [base] "r" (base), [mprv] "r" (__mstatus_adjust), "r" (__mepc));
+    hi = 0;
+  } else {
+    asm ("csrrs %[mstatus], mstatus, %[mprv]\n"
+         STR(LOAD) " %[lo], 0(%[base])\n"
+         STR(LOAD) " %[hi], %[next](%[base])\n"
+         "csrw mstatus, %[mstatus]"
+         : [mstatus] "+&r" (__mstatus), [lo] "=&r" (lo), [hi] "=&r" (hi)
+         : [base] "r" (base), [next] "i" (sizeof(uintptr_t)),
+           [mprv] "r" (__mstatus_adjust), "r" (__mepc));
+    hi <<= 8 * sizeof(uintptr_t) - shift; // shift is nonzero here
+  }
+
+  uintptr_t val = lo >> shift | hi;
+  if (len < sizeof(uintptr_t))
+    val &= ((uintptr_t)1 << 8 * len) - 1;
+  return val;
+}
+
+static inline void store_misaligned(uintptr_t addr, uintptr_t val, int len, uintptr_t mepc)
+{
+  register uintptr_t __mstatus_adjust asm ("a1") = MSTATUS_MPRV;
+  register uintptr_t __mepc asm ("a2") = mepc;
+  register uintptr_t __mstatus asm ("a3");
+  uintptr_t tmp;
+
+  asm volatile ("csrrs %[mstatus], mstatus, %[mprv]\n"
+                "1:\n"
+                "and %[tmp], %[addr], 1\n"
+                "bnez %[tmp], 2f\n"
+                "li %[tmp], 2\n"
+                "bltu %[len], %[tmp], 2f\n"
+                "and %[tmp], %[addr], 2\n"
+                "bnez %[tmp], 3f\n"
+                "li %[tmp], 4\n"
+                "bltu %[len], %[tmp], 3f\n"
+                "sw %[val], 0(%[addr])\n"
+                "add %[addr], %[addr], 4\n"
+                "add %[len], %[len], -4\n"
+#if __riscv_xlen == 64
+                "srl %[val], %[val], 32\n"
+#endif
+                "j 4f\n"
+                "2:\n"
+                "sb %[val], 0(%[addr])\n"
+                "add %[addr], %[addr], 1\n"
+                "add %[len], %[len], -1\n"
+                "srl %[val], %[val], 8\n"
+                "j 4f\n"
+                "3:\n"
+                "sh %[val], 0(%[addr])\n"
+                "add %[addr], %[addr], 2\n"
+                "add %[len], %[len], -2\n"
+                "srl %[val], %[val], 16\n"
+                "4:\n"
+                "bnez %[len], 1b\n"
+                "csrw mstatus, %[mstatus]"
+                : [mstatus] "+&r" (__mstatus), [tmp] "=&r" (tmp),
+                  [addr] "+&r" (addr), [val] "+&r" (val), [len] "+&r" (len)
+                : [mprv] "r" (__mstatus_adjust), "r" (__mepc)
+                : "memory");
+}
 #endif
 
 static unsigned long __attribute__((always_inline)) get_insn(uintptr_t mepc, uintptr_t* mstatus)
@@ -68,6 +68,7 @@ void load_elf(const char* fn, elf_info* info)
   if (eh.e_type == ET_DYN)
     bias = RISCV_PGSIZE;
 
+  info->bias = bias;
   info->entry = eh.e_entry + bias;
   int flags = MAP_FIXED | MAP_PRIVATE;
   for (int i = eh.e_phnum - 1; i >= 0; i--) {
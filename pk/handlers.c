@@ -4,6 +4,7 @@
 #include "config.h"
 #include "syscall.h"
 #include "mmap.h"
+#include "profile.h"
 
 static void handle_instruction_access_fault(trapframe_t *tf)
 {
@@ -95,6 +96,11 @@ static void handle_syscall(trapframe_t* tf)
 
 static void handle_interrupt(trapframe_t* tf)
 {
+  if ((tf->cause << 1) == (IRQ_S_TIMER << 1))
+    return profile_tick(tf);
+  if ((tf->cause << 1) == (IRQ_LCOF << 1))
+    return profile_overflow(tf);
+
   clear_csr(sip, SIP_SSIP);
 }
 
@@ -5,11 +5,13 @@
 #include "boot.h"
 #include "elf.h"
 #include "mtrap.h"
+#include "boot_profile.h"
 #include "frontend.h"
+#include "profile.h"
 #include <stdbool.h>
 
 elf_info current;
-long disabled_hart_mask;
+hart_mask_t disabled_hart_mask;
 
 static void help()
 {
@@ -19,6 +21,14 @@ static void help()
   printk("  -h, --help            Print this help message\n");
   printk("  -p                    Disable on-demand program paging\n");
   printk("  -s                    Print cycles upon termination\n");
+  printk("  -P                    Sample the PC on the timer, writing a pprof profile\n");
+  printk("                        to pk.prof upon termination\n");
+  printk("  --profile=FILE        As -P, writing FILE\n");
+  printk("  --profile-ticks=N     Sample every N ticks of the time CSR (default 10000)\n");
+  printk("  --profile-ra          Also record ra, as a one-level call stack\n");
+  printk("  --sample=EVENT        Sample the PC on the overflow of a counter of EVENT,\n");
+  printk("                        writing pk.prof.EVENT (needs Sscofpmf)\n");
+  printk("  --sample-period=N     Sample every N events (default 10000)\n");
 
   shutdown(0);
 }
@@ -46,6 +56,9 @@ static void handle_option(const char* arg)
     return;
   }
 
+  if (profile_option(arg)) // sample the PC on the timer or on events
+    return;
+
   panic("unrecognized option: `%s'", arg);
   suggest_help();
 }
@@ -166,9 +179,15 @@ static void run_loaded_program(size_t argc, char** argv, uintptr_t kstack_top)
     current.cycle0 = rdcycle64();
     current.instret0 = rdinstret64();
   }
+  profile_start(argv[0]);
 
   trapframe_t tf;
   init_tf(&tf, current.entry, stack_top);
+  boot_phase("handoff");
+#ifdef PK_PRINT_BOOT_PROFILE
+  boot_profile_print(printk);
+#endif
+
   asm volatile ("fence.i" ::: "memory");
   write_csr(sscratch, kstack_top);
   start_user(&tf);
@@ -176,6 +195,8 @@ static void run_loaded_program(size_t argc, char** argv, uintptr_t kstack_top)
 
 static void rest_of_boot_loader(uintptr_t kstack_top)
 {
+  boot_phase("pk_vm_init");
+
   arg_buf args;
   size_t argc = parse_args(&args);
   if (!argc)
@@ -186,6 +207,7 @@ static void rest_of_boot_loader(uintptr_t kstack_top)
   current.phdr = (uintptr_t)phdrs;
   current.phdr_size = sizeof(phdrs);
   load_elf(args.argv[0], &current);
+  boot_phase("load_elf");
 
   run_loaded_program(argc, args.argv, kstack_top);
 }
@@ -199,6 +221,7 @@ void boot_loader(uintptr_t dtb)
   set_csr(sstatus, SSTATUS_SUM | SSTATUS_FS | SSTATUS_VS);
 
   file_init();
+  boot_phase("file_init");
   enter_supervisor_mode(rest_of_boot_loader, pk_vm_init(), 0);
 }
 
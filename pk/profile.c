@@ -0,0 +1,350 @@
+// See LICENSE for license details.
+
+#include "profile.h"
+#include "boot.h"
+#include "elf.h"
+#include "file.h"
+#include "mmap.h"
+#include "mcall.h"
+#include "bits.h"
+#include "hpm_events.h"
+#include <fcntl.h>
+#include <string.h>
+
+#define PROFILE_BUCKETS 4096 // distinct (pc, ra, source) triples kept
+#define PROFILE_PROBES 32 // before a sample is dropped
+#define PROFILE_DEFAULT_TICKS 10000
+#define PROFILE_DEFAULT_PERIOD 10000
+#define PROFILE_EVENTS 4 // sampled at once
+
+// Samples of the timer have source 0, and of event i, source i + 1
+struct profile_bucket {
+  unsigned long pc, ra;
+  unsigned int count, source;
+};
+
+static struct profile_bucket profile_buckets[PROFILE_BUCKETS];
+static unsigned long profile_dropped;
+
+static char profile_path[256] = "pk.prof";
+static int profile_timer; // sample on the timer
+static unsigned long profile_ticks = PROFILE_DEFAULT_TICKS;
+static int profile_ra; // also record ra, as the caller
+
+static const struct {
+  const char* name;
+  unsigned long mhpmevent;
+} profile_hpm_events[] = {
+#define X(event, name) { name, event },
+  HPM_EVENT_LIST(X)
+#undef X
+};
+
+// Events sampled on counter overflow, through the SBI PMU and Sscofpmf
+static struct {
+  int hpm_event; // in profile_hpm_events
+  unsigned long counter;
+} profile_events[PROFILE_EVENTS];
+static int profile_nevents;
+static unsigned long profile_period = PROFILE_DEFAULT_PERIOD;
+
+// The program's executable segment, for the profile's memory map
+static char profile_program[256];
+static unsigned long profile_text_start, profile_text_end, profile_text_offset;
+
+static void profile_copy(char* dest, size_t size, const char* src)
+{
+  size_t len = strlen(src);
+  if (len >= size)
+    panic("profile: name too long: `%s'", src);
+  memcpy(dest, src, len + 1);
+}
+
+// The rest of arg after prefix, or NULL if arg does not start with it
+static const char* option_value(const char* arg, const char* prefix)
+{
+  while (*prefix)
+    if (*arg++ != *prefix++)
+      return NULL;
+  return arg;
+}
+
+static unsigned long option_count(const char* value)
+{
+  long n = atol(value);
+  if (n <= 0)
+    panic("profile: bad count: `%s'", value);
+  return n;
+}
+
+static void option_event(const char* name)
+{
+  if (profile_nevents == PROFILE_EVENTS)
+    panic("profile: at most %d events can be sampled", PROFILE_EVENTS);
+  for (int i = 0; i < ARRAY_SIZE(profile_hpm_events); i++) {
+    if (strcmp(name, profile_hpm_events[i].name) == 0) {
+      profile_events[profile_nevents++].hpm_event = i;
+      return;
+    }
+  }
+  panic("profile: unknown event: `%s'", name);
+}
+
+int profile_option(const char* arg)
+{
+  const char* value;
+
+  if (strcmp(arg, "-P") == 0) {
+    profile_timer = 1;
+    return 1;
+  }
+  if ((value = option_value(arg, "--profile="))) {
+    profile_copy(profile_path, sizeof(profile_path), value);
+    profile_timer = 1;
+    return 1;
+  }
+  if ((value = option_value(arg, "--profile-ticks="))) {
+    profile_ticks = option_count(value);
+    return 1;
+  }
+  if (strcmp(arg, "--profile-ra") == 0) {
+    profile_ra = 1;
+    return 1;
+  }
+  if ((value = option_value(arg, "--sample="))) {
+    option_event(value);
+    return 1;
+  }
+  if ((value = option_value(arg, "--sample-period="))) {
+    profile_period = option_count(value);
+    return 1;
+  }
+  return 0;
+}
+
+struct profile_sbiret {
+  long error;
+  long value;
+};
+
+static struct profile_sbiret profile_sbi(unsigned long ext, unsigned long fid,
+                                         unsigned long arg0, unsigned long arg1,
+                                         unsigned long arg2, unsigned long arg3,
+                                         unsigned long arg4, unsigned long arg5)
+{
+  register unsigned long a0 asm("a0") = arg0;
+  register unsigned long a1 asm("a1") = arg1;
+  register unsigned long a2 asm("a2") = arg2;
+  register unsigned long a3 asm("a3") = arg3;
+  register unsigned long a4 asm("a4") = arg4;
+  register unsigned long a5 asm("a5") = arg5;
+  register unsigned long a6 asm("a6") = fid;
+  register unsigned long a7 asm("a7") = ext;
+  asm volatile ("ecall"
+                : "+r" (a0), "+r" (a1)
+                : "r" (a2), "r" (a3), "r" (a4), "r" (a5), "r" (a6), "r" (a7)
+                : "memory");
+  return (struct profile_sbiret) { a0, a1 };
+}
+
+// 64-bit SBI arguments take a pair of registers on RV32
+#if __riscv_xlen == 32
+# define PROFILE_ARG64(x) (unsigned long)(x), (unsigned long)((uint64_t)(x) >> 32)
+#else
+# define PROFILE_ARG64(x) (x), 0
+#endif
+
+static void profile_set_timer(uint64_t when)
+{
+  profile_sbi(SBI_EXT_TIME, SBI_EXT_TIME_SET_TIMER, PROFILE_ARG64(when), 0, 0, 0, 0);
+}
+
+// Count down from the period, so that the counter overflows at its end
+static void profile_arm(int i)
+{
+  struct profile_sbiret ret = profile_sbi(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_START,
+    profile_events[i].counter, 1, SBI_PMU_START_FLAG_SET_INIT_VALUE,
+    PROFILE_ARG64(-(uint64_t)profile_period), 0);
+  if (ret.error)
+    panic("profile: couldn't start counter %ld: %ld", profile_events[i].counter, ret.error);
+}
+
+static void profile_start_events()
+{
+  // LCOFIE is read-only zero without Sscofpmf, or if the SBI doesn't
+  // delegate LCOFIP, and then no overflow would ever be sampled
+  set_csr(sie, SIP_LCOFIP);
+  if (!(read_csr(sie) & SIP_LCOFIP))
+    panic("profile: --sample needs Sscofpmf, with LCOFIP delegated");
+
+  for (int i = 0; i < profile_nevents; i++) {
+    unsigned long event = profile_hpm_events[profile_events[i].hpm_event].mhpmevent;
+    // Count only the program, not pk or the SBI beneath it
+    struct profile_sbiret ret = profile_sbi(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_CONFIG_MATCHING,
+      0, -1U, SBI_PMU_CFG_FLAG_SET_SINH | SBI_PMU_CFG_FLAG_SET_MINH,
+      SBI_PMU_EVENT_TYPE_RAW << 16, PROFILE_ARG64(event));
+    if (ret.error)
+      panic("profile: no counter for %s: %ld",
+            profile_hpm_events[profile_events[i].hpm_event].name, ret.error);
+    profile_events[i].counter = ret.value;
+    profile_arm(i);
+  }
+}
+
+void profile_start(const char* program)
+{
+  if (!profile_timer && !profile_nevents)
+    return;
+
+  profile_copy(profile_program, sizeof(profile_program), program);
+  Elf_Phdr* ph = (Elf_Phdr*)current.phdr;
+  for (int i = 0; i < current.phnum; i++) {
+    if (ph[i].p_type == PT_LOAD && (ph[i].p_flags & PF_X)) {
+      uintptr_t prepad = ph[i].p_vaddr % RISCV_PGSIZE;
+      profile_text_start = ph[i].p_vaddr + current.bias - prepad;
+      profile_text_end = ROUNDUP(ph[i].p_vaddr + current.bias + ph[i].p_memsz, RISCV_PGSIZE);
+      profile_text_offset = ph[i].p_offset - prepad;
+      break;
+    }
+  }
+
+  if (profile_nevents)
+    profile_start_events();
+  if (profile_timer) {
+    set_csr(sie, SIP_STIP);
+    profile_set_timer(rdtime64() + profile_ticks);
+  }
+}
+
+static void profile_record(unsigned long pc, unsigned long ra, unsigned int source)
+{
+  unsigned long hash = ((pc >> 1) ^ (ra << 7) ^ source) * 2654435761UL;
+  hash ^= hash >> 16;
+
+  for (int i = 0; i < PROFILE_PROBES; i++) {
+    struct profile_bucket* b = &profile_buckets[(hash + i) % PROFILE_BUCKETS];
+    if (b->count && (b->pc != pc || b->ra != ra || b->source != source))
+      continue;
+    b->pc = pc;
+    b->ra = ra;
+    b->source = source;
+    b->count++;
+    return;
+  }
+  profile_dropped++;
+}
+
+// Interrupts are only taken from user mode, so epc is always the program's
+void profile_tick(trapframe_t* tf)
+{
+  profile_record((unsigned long)tf->epc, profile_ra ? (unsigned long)tf->gpr[1] : 0, 0);
+  // Setting the timer clears STIP
+  profile_set_timer(rdtime64() + profile_ticks);
+}
+
+// The PC is that of an instruction shortly after the one that overflowed
+// the counter, by however long the interrupt took to be taken
+void profile_overflow(trapframe_t* tf)
+{
+  unsigned long overflowed;
+
+  clear_csr(sip, SIP_LCOFIP);
+  overflowed = read_csr(scountovf);
+
+  for (int i = 0; i < profile_nevents; i++) {
+    if (!((overflowed >> profile_events[i].counter) & 1))
+      continue;
+    profile_record((unsigned long)tf->epc, profile_ra ? (unsigned long)tf->gpr[1] : 0, i + 1);
+    // Starting the counter again clears its overflow bit
+    profile_sbi(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_STOP, profile_events[i].counter, 1, 0, 0, 0, 0);
+    profile_arm(i);
+  }
+}
+
+struct profile_writer {
+  file_t* file;
+  size_t n;
+  unsigned long buf[256];
+};
+
+static void profile_flush(struct profile_writer* w)
+{
+  file_write(w->file, w->buf, w->n * sizeof(w->buf[0]));
+  w->n = 0;
+}
+
+static void profile_put(struct profile_writer* w, unsigned long word)
+{
+  if (w->n == ARRAY_SIZE(w->buf))
+    profile_flush(w);
+  w->buf[w->n++] = word;
+}
+
+// The legacy gperftools format, in XLEN-bit words: a header, then
+// (count, depth, pc, caller...) per stack, a trailer and /proc/pid/maps.
+// The header's sampling period is in time ticks or events, not microseconds.
+static void profile_write(const char* path, unsigned int source, unsigned long period)
+{
+  struct profile_writer w;
+  char maps[512];
+
+  w.n = 0;
+  w.file = file_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (IS_ERR_VALUE(w.file)) {
+    printk("couldn't write profile %s\n", path);
+    return;
+  }
+
+  profile_put(&w, 0);
+  profile_put(&w, 3);
+  profile_put(&w, 0);
+  profile_put(&w, period);
+  profile_put(&w, 0);
+  for (int i = 0; i < PROFILE_BUCKETS; i++) {
+    struct profile_bucket* b = &profile_buckets[i];
+    if (!b->count || b->source != source)
+      continue;
+    profile_put(&w, b->count);
+    profile_put(&w, b->ra ? 2 : 1);
+    profile_put(&w, b->pc);
+    if (b->ra)
+      profile_put(&w, b->ra);
+  }
+  profile_put(&w, 0);
+  profile_put(&w, 1);
+  profile_put(&w, 0);
+  profile_flush(&w);
+
+  int len = snprintf(maps, sizeof(maps), "%lx-%lx r-xp %lx 00:00 0 %s\n",
+                     profile_text_start, profile_text_end, profile_text_offset,
+                     profile_program);
+  file_write(w.file, maps, len < sizeof(maps) ? len : sizeof(maps) - 1);
+  file_decref(w.file);
+}
+
+// The timer's samples go to the profile path, and each event's to the
+// path with the event's name appended
+void profile_finish()
+{
+  char path[sizeof(profile_path) + 32];
+
+  if (profile_timer) {
+    clear_csr(sie, SIP_STIP);
+    profile_set_timer(-1ULL);
+    profile_write(profile_path, 0, profile_ticks);
+  }
+
+  if (profile_nevents) {
+    clear_csr(sie, SIP_LCOFIP);
+    for (int i = 0; i < profile_nevents; i++) {
+      const char* name = profile_hpm_events[profile_events[i].hpm_event].name;
+      profile_sbi(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_STOP, profile_events[i].counter, 1,
+                  SBI_PMU_STOP_FLAG_RESET, 0, 0, 0);
+      snprintf(path, sizeof(path), "%s.%s", profile_path, name);
+      profile_write(path, i + 1, profile_period);
+    }
+  }
+
+  if (profile_dropped)
+    printk("profile: %ld samples dropped\n", profile_dropped);
+}
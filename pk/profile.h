@@ -0,0 +1,17 @@
+// See LICENSE for license details.
+
+#ifndef _PK_PROFILE_H
+#define _PK_PROFILE_H
+
+#include "pk.h"
+
+// Sampling of the user program's PC on the supervisor timer, and on the
+// overflow of HPM counters.  The samples are written at exit as gperftools
+// CPU profiles, which pprof reads.
+int profile_option(const char* arg);
+void profile_start(const char* program);
+void profile_tick(trapframe_t* tf);
+void profile_overflow(trapframe_t* tf);
+void profile_finish();
+
+#endif
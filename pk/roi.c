@@ -0,0 +1,128 @@
+// See LICENSE for license details.
+
+#include "roi.h"
+#include "pk.h"
+#include "syscall.h"
+#include <string.h>
+#include <errno.h>
+
+#define ROI_MAX 16
+#define ROI_NAME_LEN 32
+#define ROI_HPM_FIRST 3
+#define ROI_COUNTERS 32 // time, cycle, instret and the HPM counters
+
+// Indexed as the counter CSRs: cycle, time, instret, hpmcounter3-31
+typedef struct {
+  uint64_t counter[ROI_COUNTERS];
+} roi_snapshot;
+
+typedef struct {
+  char name[ROI_NAME_LEN];
+  int open;
+  unsigned long entries;
+  roi_snapshot start;
+  roi_snapshot total;
+} roi_t;
+
+static roi_t rois[ROI_MAX];
+static int nrois;
+
+#define HPM_COUNTERS(X) \
+  X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) \
+  X(15) X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25) \
+  X(26) X(27) X(28) X(29) X(30) X(31)
+
+#if __riscv_xlen == 32
+# define read_counter(reg) ({ uint32_t hi, lo; \
+  do { hi = read_csr(reg##h); lo = read_csr(reg); } \
+  while (hi != read_csr(reg##h)); \
+  ((uint64_t)hi << 32) | lo; })
+#else
+# define read_counter(reg) ((uint64_t)read_csr(reg))
+#endif
+
+// HPM counters that are not implemented read as zero, so are never shown
+static void roi_snap(roi_snapshot* s)
+{
+  s->counter[0] = rdcycle64();
+  s->counter[1] = rdtime64();
+  s->counter[2] = rdinstret64();
+#define X(n) s->counter[n] = read_counter(hpmcounter##n);
+  HPM_COUNTERS(X)
+#undef X
+}
+
+static roi_t* roi_find(const char* name)
+{
+  for (int i = 0; i < nrois; i++)
+    if (strcmp(rois[i].name, name) == 0)
+      return &rois[i];
+  return NULL;
+}
+
+static roi_t* roi_create(const char* name)
+{
+  if (nrois == ROI_MAX)
+    return NULL;
+
+  roi_t* roi = &rois[nrois++];
+  strcpy(roi->name, name);
+  return roi;
+}
+
+// A region may be entered many times; its deltas are summed
+long sys_roi(long op, const char* name)
+{
+  char buf[ROI_NAME_LEN];
+  roi_snapshot now;
+  roi_t* roi;
+
+  // Count as little of pk as possible: snapshot the end of a region on
+  // the way in, and its start on the way out
+  roi_snap(&now);
+
+  size_t len = strlen(name);
+  if (len >= ROI_NAME_LEN)
+    return -ENAMETOOLONG;
+  memcpy(buf, name, len + 1);
+  roi = roi_find(buf);
+
+  switch (op)
+  {
+    case PK_ROI_BEGIN:
+      if (!roi && !(roi = roi_create(buf)))
+        return -ENOSPC;
+      if (roi->open)
+        return -EBUSY;
+      roi->open = 1;
+      roi_snap(&roi->start);
+      return 0;
+    case PK_ROI_END:
+      if (!roi || !roi->open)
+        return -EINVAL;
+      for (int i = 0; i < ROI_COUNTERS; i++)
+        roi->total.counter[i] += now.counter[i] - roi->start.counter[i];
+      roi->entries++;
+      roi->open = 0;
+      return 0;
+  }
+  return -EINVAL;
+}
+
+void roi_print()
+{
+  static const char* const names[ROI_HPM_FIRST] = { "cycles", "ticks", "instructions" };
+
+  for (int i = 0; i < nrois; i++) {
+    roi_t* roi = &rois[i];
+    printk("roi %s: %ld entries%s\n", roi->name, roi->entries,
+           roi->open ? ", still open" : "");
+    for (int j = 0; j < ROI_COUNTERS; j++) {
+      uint64_t delta = roi->total.counter[j];
+      if (j < ROI_HPM_FIRST)
+        printk("  %lld %s\n", delta, names[j]);
+      else if (delta)
+        printk("  %lld hpmcounter%d\n", delta, j);
+    }
+  }
+}
@@ -0,0 +1,14 @@
+// See LICENSE for license details.
+
+#ifndef _PK_ROI_H
+#define _PK_ROI_H
+
+// Regions of interest: a program brackets the code it wants measured with
+// SYS_pk_roi calls, and the counters' deltas are printed at exit
+#define PK_ROI_BEGIN 0
+#define PK_ROI_END 1
+
+long sys_roi(long op, const char* name);
+void roi_print();
+
+#endif
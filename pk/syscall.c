@@ -6,6 +6,8 @@
 #include "frontend.h"
 #include "mmap.h"
 #include "boot.h"
+#include "profile.h"
+#include "roi.h"
 #include <string.h>
 #include <errno.h>
 
@@ -15,6 +17,7 @@ typedef long (*syscall_t)(long, long, long, long, long, long, long);
 
 void sys_exit(int code)
 {
+  profile_finish();
   if (current.cycle0) {
     uint64_t dt = rdtime64() - current.time0;
     uint64_t dc = rdcycle64() - current.cycle0;
@@ -26,6 +29,7 @@ void sys_exit(int code)
     printk("%d.%d%d CPI\n", (int)(dc/di), (int)(10ULL*dc/di % 10),
         (int)((100ULL*dc + di/2)/di % 10));
   }
+  roi_print();
   shutdown(code);
 }
 
@@ -508,6 +512,8 @@ long do_syscall(long a0, long a1, long a2, long a3, long a4, long a5, unsigned l
     f = syscall_table[n];
   else if (n - OLD_SYSCALL_THRESHOLD < ARRAY_SIZE(old_syscall_table))
     f = old_syscall_table[n - OLD_SYSCALL_THRESHOLD];
+  else if (n == SYS_pk_roi)
+    f = (syscall_t)sys_roi;
 
   if (!f)
     panic("bad syscall #%ld!",n);
@@ -65,6 +65,8 @@
 #define SYS_lstat 1039
 #define SYS_time 1062
 
+#define SYS_pk_roi 2048 // pk's own, for the regions of interest in roi.h
+
 #define IS_ERR_VALUE(x) ((unsigned long)(x) >= (unsigned long)-4096)
 #define ERR_PTR(x) ((void*)(long)(x))
 #define PTR_ERR(x) ((long)(x))
@@ -0,0 +1,177 @@
+// See LICENSE for license details.
+//
+// Host-side differential test of the fp_emulation fast paths against
+// softfloat.  Every operation the fast paths accept must give softfloat's
+// result and fflags bit for bit; the rest only need to be declined.  Built
+// and run by host-test.sh, which compiles softfloat for the host with
+// softfloat_roundingMode and softfloat_raiseFlags bound to the variables
+// below, in place of the frm and fflags CSRs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fp_fastpath.h"
+
+int host_rounding_mode;
+int host_fflags;
+
+static uint64_t rand_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rand64()
+{
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  return rand_state;
+}
+
+// Operands biased towards the edges the fast paths must decline or round:
+// zeros, subnormals, infinities and NaNs, the extreme exponents, and
+// nearby exponents, whose sums cancel and whose products carry
+static uint32_t rand_f32()
+{
+  uint64_t r = rand64();
+  uint32_t v = r;
+  switch (r >> 58) {
+    case 0: return v & 0x807FFFFF;
+    case 1: return v | 0x7F800000;
+    case 2: return (v & 0x807FFFFF) | (uint32_t)(0x7F + (int)(r >> 40 & 31) - 16) << 23;
+    case 3: return (v & 0x80000000) | 0x00800000 | (v & 15);
+    case 4: return (v & 0x807FFFFF) | 0x7F000000;
+    case 5: return (v & 0x807FFFFF) | 0x00800000;
+  }
+  return v;
+}
+
+static uint64_t rand_f64()
+{
+  uint64_t v = rand64();
+  switch (v >> 58) {
+    case 0: return v & UINT64_C(0x800FFFFFFFFFFFFF);
+    case 1: return v | UINT64_C(0x7FF0000000000000);
+    case 2: return (v & UINT64_C(0x800FFFFFFFFFFFFF)) | (uint64_t)(0x3FF + (int)(v >> 40 & 63) - 32) << 52;
+    case 3: return (v & UINT64_C(0x8000000000000000)) | UINT64_C(0x0010000000000000) | (v & 15);
+    case 4: return (v & UINT64_C(0x800FFFFFFFFFFFFF)) | UINT64_C(0x7FE0000000000000);
+    case 5: return (v & UINT64_C(0x800FFFFFFFFFFFFF)) | UINT64_C(0x0010000000000000);
+  }
+  return v;
+}
+
+static long cases, fast, bad;
+
+static void check_f32(int mul, uint32_t a, uint32_t b)
+{
+  uint32_t z_fast, z_soft;
+  int flags_fast, flags_soft, taken;
+
+  host_fflags = 0;
+  taken = mul ? f32_mul_fast(a, b, &z_fast) : f32_add_fast(a, b, &z_fast);
+  flags_fast = host_fflags;
+  host_fflags = 0;
+  z_soft = (mul ? f32_mul((float32_t){ a }, (float32_t){ b })
+                : f32_add((float32_t){ a }, (float32_t){ b })).v;
+  flags_soft = host_fflags;
+
+  cases++;
+  if (!taken)
+    return;
+  fast++;
+  if (z_fast != z_soft || flags_fast != flags_soft) {
+    if (bad++ < 10)
+      printf("f32_%s(%08x, %08x) rm %d: fast %08x/%02x, softfloat %08x/%02x\n",
+             mul ? "mul" : "add", a, b, host_rounding_mode,
+             z_fast, flags_fast, z_soft, flags_soft);
+  }
+}
+
+static void check_f64(int mul, uint64_t a, uint64_t b)
+{
+  uint64_t z_fast, z_soft;
+  int flags_fast, flags_soft, taken;
+
+  host_fflags = 0;
+  taken = mul ? f64_mul_fast(a, b, &z_fast) : f64_add_fast(a, b, &z_fast);
+  flags_fast = host_fflags;
+  host_fflags = 0;
+  z_soft = (mul ? f64_mul((float64_t){ a }, (float64_t){ b })
+                : f64_add((float64_t){ a }, (float64_t){ b })).v;
+  flags_soft = host_fflags;
+
+  cases++;
+  if (!taken)
+    return;
+  fast++;
+  if (z_fast != z_soft || flags_fast != flags_soft) {
+    if (bad++ < 10)
+      printf("f64_%s(%016llx, %016llx) rm %d: fast %016llx/%02x, softfloat %016llx/%02x\n",
+             mul ? "mul" : "add", (unsigned long long)a, (unsigned long long)b,
+             host_rounding_mode, (unsigned long long)z_fast, flags_fast,
+             (unsigned long long)z_soft, flags_soft);
+  }
+}
+
+static double seconds()
+{
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// Add and multiply normal operands, which every call takes the fast path for
+static void bench(long n)
+{
+  volatile uint64_t sink = 0;
+  uint64_t z;
+  double t;
+
+  host_rounding_mode = softfloat_round_near_even;
+  rand_state = 1;
+  t = seconds();
+  for (long i = 0; i < n; i++) {
+    uint64_t a = UINT64_C(0x3FF0000000000000) | rand64() >> 12;
+    uint64_t b = UINT64_C(0x4000000000000000) | rand64() >> 12;
+    f64_add_fast(a, b, &z);
+    sink += z;
+    f64_mul_fast(a, b, &z);
+    sink += z;
+  }
+  double t_fast = seconds() - t;
+
+  rand_state = 1;
+  t = seconds();
+  for (long i = 0; i < n; i++) {
+    uint64_t a = UINT64_C(0x3FF0000000000000) | rand64() >> 12;
+    uint64_t b = UINT64_C(0x4000000000000000) | rand64() >> 12;
+    sink += f64_add((float64_t){ a }, (float64_t){ b }).v;
+    sink += f64_mul((float64_t){ a }, (float64_t){ b }).v;
+  }
+  double t_soft = seconds() - t;
+
+  printf("f64 add+mul: fast path %.1f ns, softfloat %.1f ns\n",
+         t_fast * 1e9 / n, t_soft * 1e9 / n);
+}
+
+int main(int argc, char** argv)
+{
+  long n = argc > 1 ? atol(argv[1]) : 10000000;
+
+  for (long i = 0; i < n; i++) {
+    // One in eight under another rounding mode, which must be declined
+    host_rounding_mode = (i & 7) == 7 ? (int)(rand64() % 5) : softfloat_round_near_even;
+    int mul = i & 1;
+    if (i & 2) {
+      uint64_t a = rand_f64(), b = rand_f64();
+      // Near-cancelling sums, the subtraction's hard case
+      if (i & 4)
+        b = (a ^ UINT64_C(0x8000000000000000)) + (int)(rand64() % 5) - 2;
+      check_f64(mul, a, b);
+    } else {
+      uint32_t a = rand_f32(), b = rand_f32();
+      if (i & 4)
+        b = (a ^ 0x80000000) + (int)(rand64() % 5) - 2;
+      check_f32(mul, a, b);
+    }
+  }
+
+  printf("%ld cases, %ld on the fast path, %ld mismatches\n", cases, fast, bad);
+  bench(n / 4);
+  return bad != 0;
+}
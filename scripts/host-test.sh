@@ -0,0 +1,65 @@
+#!/bin/sh
+# See LICENSE for license details.
+#=========================================================================
+# host-test.sh [fp|muldiv]...
+#=========================================================================
+# Build the emulation code that has a host-side test for the build
+# machine, with $HOST_CC, and run the tests: by default all of them.
+#
+#  - fp     : the fp_emulation fast paths against softfloat, built for
+#             both of their f64_mul variants
+#  - muldiv : the M extension emulation against the host's operators,
+#             at XLEN 32 and 64
+#
+# $HOST_TEST_CASES overrides each test's number of random cases.
+
+set -e
+
+HOST_CC=${HOST_CC:-cc}
+HOST_CFLAGS=${HOST_CFLAGS:--O2}
+scripts_dir=$(cd "$(dirname "$0")" && pwd)
+src_dir=$(dirname "$scripts_dir")
+build_dir=$(mktemp -d)
+trap 'rm -rf "$build_dir"' EXIT
+
+test_fp()
+{
+  # softfloat reads the rounding mode and raises flags through macros
+  # from fp_emulation.h; on the host they are a pair of variables
+  cat > "$build_dir/fp_emulation.h" <<EOF
+extern int host_rounding_mode, host_fflags;
+#define softfloat_roundingMode host_rounding_mode
+#define softfloat_raiseFlags(which) (host_fflags |= (which))
+EOF
+  mkdir -p "$build_dir/softfloat"
+  srcs=$(sed -n '/^softfloat_c_srcs/,/^$/s/[\\ 	]//gp' "$src_dir/softfloat/softfloat.mk.in" | grep '\.c$')
+  for src in $srcs; do
+    $HOST_CC $HOST_CFLAGS -I"$build_dir" -I"$src_dir/softfloat" \
+      -c "$src_dir/softfloat/$src" -o "$build_dir/softfloat/${src%.c}.o"
+  done
+
+  # The RV64 with M f64_mul multiplies with __int128; the rest in 32-bit parts
+  for variant in "" "-D__riscv_xlen=64 -D__riscv_muldiv"; do
+    $HOST_CC $HOST_CFLAGS $variant -I"$build_dir" -I"$src_dir/softfloat" -I"$src_dir/machine" \
+      "$scripts_dir/fp-fastpath-test.c" "$build_dir"/softfloat/*.o -o "$build_dir/fp-fastpath-test"
+    echo "fp ${variant:-(32-bit f64_mul)}:"
+    "$build_dir/fp-fastpath-test" $HOST_TEST_CASES
+  done
+}
+
+test_muldiv()
+{
+  for xlen in 32 64; do
+    $HOST_CC $HOST_CFLAGS -DHOST_XLEN=$xlen -I"$src_dir/machine" \
+      "$scripts_dir/muldiv-test.c" -o "$build_dir/muldiv-test"
+    "$build_dir/muldiv-test" $HOST_TEST_CASES
+  done
+}
+
+[ $# -eq 0 ] && set -- fp muldiv
+for test in "$@"; do
+  case "$test" in
+    fp|muldiv) test_$test ;;
+    *) echo "$0: unknown test: $test" 1>&2; exit 1 ;;
+  esac
+done
@@ -0,0 +1,196 @@
+// See LICENSE for license details.
+//
+// Host-side test of the M extension emulation against the host's own
+// operators.  muldiv_emulation.c is included whole, with emulation.h
+// replaced by the few definitions it needs, and each instruction is run
+// through emulate_mul_div (and emulate_mul_div32 on RV64) by its encoding.
+// host-test.sh builds it with -DHOST_XLEN=32 and 64; at 32, uintptr_t is
+// narrowed so that the helpers work on 32-bit registers as on RV32.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "encoding.h"
+
+#if HOST_XLEN == 32
+# define __riscv_xlen 32
+# define uintptr_t uint32_t
+# define intptr_t int32_t
+typedef int64_t dword_t;
+typedef uint64_t udword_t;
+#else
+# define __riscv_xlen 64
+typedef __int128 dword_t;
+typedef unsigned __int128 udword_t;
+#endif
+
+#define _RISCV_EMULATION_H
+typedef unsigned long insn_t;
+#define DECLARE_EMULATION_FUNC(name) void name(uintptr_t* regs, uintptr_t mcause, uintptr_t mepc, uintptr_t mstatus, insn_t insn)
+#define GET_RS1(insn, regs) ((regs)[((insn) >> 15) & 31])
+#define GET_RS2(insn, regs) ((regs)[((insn) >> 20) & 31])
+#define SET_RD(insn, regs, val) ((regs)[((insn) >> 7) & 31] = (val))
+
+static int illegal;
+DECLARE_EMULATION_FUNC(truly_illegal_insn)
+{
+  illegal++;
+}
+
+#include "muldiv_emulation.c"
+
+#define W (8 * (int)sizeof(uintptr_t))
+#define SMIN ((uintptr_t)1 << (W - 1))
+
+// rd = x3, rs1 = x1, rs2 = x2
+#define INSN(match) ((match) | 3 << 7 | 1 << 15 | 2 << 20)
+
+static uintptr_t run(DECLARE_EMULATION_FUNC((*emulate)), insn_t insn, uintptr_t a, uintptr_t b)
+{
+  uintptr_t regs[32] = { 0 };
+  regs[1] = a;
+  regs[2] = b;
+  emulate(regs, 0, 0, 0, insn);
+  return regs[3];
+}
+
+static long checks, bad;
+
+static void expect(const char* op, uintptr_t a, uintptr_t b, uintptr_t got, uintptr_t want)
+{
+  checks++;
+  if (got != want && bad++ < 10)
+    printf("%s(%llx, %llx): got %llx, want %llx\n", op, (unsigned long long)a,
+           (unsigned long long)b, (unsigned long long)got, (unsigned long long)want);
+}
+
+// The RISC-V results, including division by zero and the most negative
+// number / -1, which C leaves undefined
+static uintptr_t ref_div(uintptr_t a, uintptr_t b)
+{
+  if (b == 0)
+    return -1;
+  if (a == SMIN && b == (uintptr_t)-1)
+    return SMIN;
+  return (intptr_t)a / (intptr_t)b;
+}
+
+static uintptr_t ref_rem(uintptr_t a, uintptr_t b)
+{
+  if (b == 0)
+    return a;
+  if (a == SMIN && b == (uintptr_t)-1)
+    return 0;
+  return (intptr_t)a % (intptr_t)b;
+}
+
+static void check(uintptr_t a, uintptr_t b)
+{
+  expect("mul", a, b, run(emulate_mul_div, INSN(MATCH_MUL), a, b), a * b);
+  expect("mulh", a, b, run(emulate_mul_div, INSN(MATCH_MULH), a, b),
+         (uintptr_t)((dword_t)(intptr_t)a * (intptr_t)b >> W));
+  expect("mulhsu", a, b, run(emulate_mul_div, INSN(MATCH_MULHSU), a, b),
+         (uintptr_t)((dword_t)(intptr_t)a * (dword_t)b >> W));
+  expect("mulhu", a, b, run(emulate_mul_div, INSN(MATCH_MULHU), a, b),
+         (uintptr_t)((udword_t)a * b >> W));
+  expect("div", a, b, run(emulate_mul_div, INSN(MATCH_DIV), a, b), ref_div(a, b));
+  expect("divu", a, b, run(emulate_mul_div, INSN(MATCH_DIVU), a, b), b ? a / b : (uintptr_t)-1);
+  expect("rem", a, b, run(emulate_mul_div, INSN(MATCH_REM), a, b), ref_rem(a, b));
+  expect("remu", a, b, run(emulate_mul_div, INSN(MATCH_REMU), a, b), b ? a % b : a);
+
+#if __riscv_xlen == 64
+  // The W forms read the low 32 bits and sign-extend their 32-bit result
+  int32_t a32 = a, b32 = b;
+  uint32_t ua32 = a, ub32 = b;
+  expect("mulw", a, b, run(emulate_mul_div32, INSN(MATCH_MULW), a, b), (int32_t)(ua32 * ub32));
+  expect("divw", a, b, run(emulate_mul_div32, INSN(MATCH_DIVW), a, b),
+         (int32_t)(!b32 ? -1 : a32 == INT32_MIN && b32 == -1 ? INT32_MIN : a32 / b32));
+  expect("divuw", a, b, run(emulate_mul_div32, INSN(MATCH_DIVUW), a, b),
+         (int32_t)(ub32 ? ua32 / ub32 : UINT32_MAX));
+  expect("remw", a, b, run(emulate_mul_div32, INSN(MATCH_REMW), a, b),
+         (int32_t)(!b32 ? a32 : a32 == INT32_MIN && b32 == -1 ? 0 : a32 % b32));
+  expect("remuw", a, b, run(emulate_mul_div32, INSN(MATCH_REMUW), a, b),
+         (int32_t)(ub32 ? ua32 % ub32 : ua32));
+#endif
+}
+
+static uint64_t rand_state = 88172645463325252ULL;
+
+static uint64_t rand64()
+{
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  return rand_state;
+}
+
+// Operands of every width, small negatives and the edges
+static uintptr_t rand_operand()
+{
+  uint64_t r = rand64();
+  uintptr_t v = r;
+  switch (r >> 60 & 7) {
+    case 0: return v >> (r >> 50 & 63) % W;
+    case 1: return -(v & 7);
+    case 2: return SMIN;
+    case 3: return v & 3;
+    case 4: return (int32_t)(v >> (r >> 50 & 31));
+  }
+  return v;
+}
+
+static double seconds()
+{
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void bench(long n)
+{
+  volatile uintptr_t sink = 0;
+  double t;
+
+  rand_state = 1;
+  t = seconds();
+  for (long i = 0; i < n; i++) {
+    uintptr_t a = rand_operand(), b = rand_operand() | 1, rem;
+    sink += mul(a, b) + mulhu(a, b) + divu(a, b, &rem) + rem;
+  }
+  double t_emul = seconds() - t;
+
+  rand_state = 1;
+  t = seconds();
+  for (long i = 0; i < n; i++) {
+    uintptr_t a = rand_operand(), b = rand_operand() | 1;
+    sink += a * b + (uintptr_t)((udword_t)a * b >> W) + a / b + a % b;
+  }
+  double t_native = seconds() - t;
+
+  printf("XLEN %d mul+mulhu+divu+remu: emulated %.1f ns, native %.1f ns\n",
+         W, t_emul * 1e9 / n, t_native * 1e9 / n);
+}
+
+int main(int argc, char** argv)
+{
+  long n = argc > 1 ? atol(argv[1]) : 1000000;
+  static const uintptr_t edges[] = {
+    0, 1, 2, 3, -1, -2, SMIN, SMIN + 1, SMIN - 1, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF,
+  };
+
+  for (int i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+    for (int j = 0; j < sizeof(edges) / sizeof(edges[0]); j++)
+      check(edges[i], edges[j]);
+  for (long i = 0; i < n; i++)
+    check(rand_operand(), rand_operand());
+
+  // Anything else with the M opcode is not emulated
+  run(emulate_mul_div, INSN(MATCH_ADD), 1, 2);
+  if (illegal != 1) {
+    printf("ADD wasn't rejected as illegal\n");
+    bad++;
+  }
+
+  printf("XLEN %d: %ld checks, %ld mismatches\n", W, checks, bad);
+  bench(n);
+  return bad != 0;
+}
@@ -0,0 +1,201 @@
+#!/bin/sh
+# See LICENSE for license details.
+#=========================================================================
+# platform-profile.sh <platform.dts|platform.dtb> <mem-start>
+#=========================================================================
+# Generate the constant platform description used by --with-platform.
+# The devices bbl would otherwise find in the FDT at boot are looked up
+# here once, with dtc and fdtget, and written to stdout as a C header.
+
+set -e
+
+if [ $# -ne 2 ]; then
+  echo "usage: $0 <platform.dts|platform.dtb> <mem-start>" 1>&2
+  exit 1
+fi
+
+DTC=${DTC:-dtc}
+FDTGET=${FDTGET:-fdtget}
+mem_start=$2
+
+case "$1" in
+  *.dts)
+    dtb=$(mktemp)
+    trap 'rm -f "$dtb"' EXIT
+    $DTC -q -I dts -O dtb -o "$dtb" "$1"
+    ;;
+  *)
+    dtb=$1
+    ;;
+esac
+
+# Print a property as hex cells or strings; nothing if it is missing
+cells() { $FDTGET -t x "$dtb" "$1" "$2" 2>/dev/null || true; }
+strings() { $FDTGET -t s "$dtb" "$1" "$2" 2>/dev/null || true; }
+has() { $FDTGET "$dtb" "$1" "$2" > /dev/null 2>&1; }
+value() { v=$(cells "$1" "$2"); echo $((0x${v:-0})); }
+
+# All node paths, parents first
+nodes() {
+  echo "$1"
+  for child in $($FDTGET -l "$dtb" "$1"); do
+    if [ "$1" = / ]; then nodes "/$child"; else nodes "$1/$child"; fi
+  done
+}
+
+parent() {
+  p=${1%/*}
+  echo "${p:-/}"
+}
+
+# Combine the first $1 hex cells of the remaining arguments into one number
+number() {
+  n=$1; shift
+  v=0
+  while [ "$n" -gt 0 ]; do
+    v=$(( (v << 32) + 0x$1 )); shift; n=$((n - 1))
+  done
+  printf '0x%x' "$v"
+}
+
+address_cells() { c=$(cells "$1" '#address-cells'); echo "${c:-2}"; }
+size_cells() { c=$(cells "$1" '#size-cells'); echo "${c:-1}"; }
+
+# The first address in a node's reg
+reg_base() { number "$(address_cells "$(parent "$1")")" $(cells "$1" reg); }
+
+compatible() {
+  case " $(strings "$1" compatible) " in
+    *" $2 "*) return 0 ;;
+  esac
+  return 1
+}
+
+all_nodes=$(nodes /)
+
+# Map the phandles of the per-hart interrupt controllers to hart ids
+harts=
+for node in $all_nodes; do
+  [ "$(strings "$node" device_type)" = cpu ] || continue
+  hart=$(number 1 $(cells "$node" reg))
+  hart=$((hart))
+  for child in $($FDTGET -l "$dtb" "$node"); do
+    if has "$node/$child" interrupt-controller; then
+      phandle=$(cells "$node/$child" phandle)
+      eval "hart_of_$((0x${phandle:-0}))=$hart"
+    fi
+  done
+  harts="$harts $hart"
+  eval "clint_$hart=-1 plic_m_$hart=-1 plic_s_$hart=-1 sswi_$hart=-1 sstc_$hart=0"
+  case "_$(strings "$node" riscv,isa)_ $(strings "$node" riscv,isa-extensions) " in
+    *_sstc_*|*" sstc "*) eval "sstc_$hart=1" ;;
+  esac
+done
+
+echo "// Generated by platform-profile.sh from $1; do not edit."
+echo
+echo "#ifndef _PLATFORM_PROFILE_H"
+echo "#define _PLATFORM_PROFILE_H"
+echo
+
+console=
+for node in $all_nodes; do
+  if [ "$(strings "$node" device_type)" = memory ]; then
+    set -- $(cells "$node" reg)
+    ac=$(address_cells "$(parent "$node")")
+    sc=$(size_cells "$(parent "$node")")
+    while [ $# -gt 0 ]; do
+      base=$(number "$ac" "$@"); shift "$ac"
+      size=$(number "$sc" "$@"); shift "$sc"
+      if [ $((base)) -le $((mem_start)) ] && [ $((mem_start)) -lt $((base + size)) ]; then
+        echo "#define PLATFORM_MEM_SIZE $size"
+      fi
+    done
+  elif [ -z "$console" ] && compatible "$node" sifive,uart0; then
+    console=uart
+    echo "#define PLATFORM_UART_BASE $(reg_base "$node")"
+    irq=$(cells "$node" interrupts | cut -d' ' -f1)
+    if [ -n "$irq" ]; then echo "#define PLATFORM_UART_IRQ $((0x$irq))"; fi
+  elif [ -z "$console" ] && { compatible "$node" ns16550a || compatible "$node" ns16750; }; then
+    console=uart16550
+    clock=$(cells "$node" clock-frequency)
+    if [ -z "$clock" ] && [ -n "$(cells "$node" clocks)" ]; then
+      phandle=$(cells "$node" clocks | cut -d' ' -f1)
+      for clk in $all_nodes; do
+        if [ "$(cells "$clk" phandle)$(cells "$clk" linux,phandle)" = "$phandle" ]; then
+          clock=$(cells "$clk" clock-frequency)
+        fi
+      done
+    fi
+    speed=$(cells "$node" current-speed)
+    echo "#define PLATFORM_UART16550_BASE ($(reg_base "$node") + $(value "$node" reg-offset))"
+    echo "#define PLATFORM_UART16550_REG_SHIFT $(value "$node" reg-shift)"
+    if [ -n "$clock" ]; then echo "#define PLATFORM_UART16550_CLOCK 0x$clock"; fi
+    if [ -n "$speed" ]; then echo "#define PLATFORM_UART16550_BAUD 0x$speed"; fi
+    irq=$(cells "$node" interrupts | cut -d' ' -f1)
+    if [ -n "$irq" ]; then echo "#define PLATFORM_UART16550_IRQ $((0x$irq))"; fi
+  elif [ -z "$console" ] && compatible "$node" ucb,htif0; then
+    console=htif
+    echo "#define PLATFORM_HTIF 1"
+  elif compatible "$node" sifive,test0; then
+    echo "#define PLATFORM_FINISHER_BASE $(reg_base "$node")"
+  elif compatible "$node" riscv,clint0; then
+    echo "#define PLATFORM_CLINT_BASE $(reg_base "$node")"
+    # Each hart has a software and a timer interrupt, in that order
+    set -- $(cells "$node" interrupts-extended)
+    index=0
+    while [ $# -ge 4 ]; do
+      eval "hart=\${hart_of_$((0x$1)):-}"
+      if [ -n "$hart" ]; then eval "clint_$hart=$index"; fi
+      index=$((index + 1)); shift 4
+    done
+  elif compatible "$node" riscv,aclint-sswi; then
+    echo "#define PLATFORM_SSWI_BASE $(reg_base "$node")"
+    set -- $(cells "$node" interrupts-extended)
+    index=0
+    while [ $# -ge 2 ]; do
+      eval "hart=\${hart_of_$((0x$1)):-}"
+      if [ -n "$hart" ] && [ $((0x$2)) -eq 1 ]; then eval "sswi_$hart=$index"; fi
+      index=$((index + 1)); shift 2
+    done
+  elif compatible "$node" riscv,plic0; then
+    echo "#define PLATFORM_PLIC_BASE $(reg_base "$node")"
+    echo "#define PLATFORM_PLIC_NDEV $(value "$node" riscv,ndev)"
+    set -- $(cells "$node" interrupts-extended)
+    index=0
+    while [ $# -ge 2 ]; do
+      eval "hart=\${hart_of_$((0x$1)):-}"
+      if [ -n "$hart" ]; then
+        case $((0x$2)) in
+          11) eval "plic_m_$hart=$index" ;;
+          9)  eval "plic_s_$hart=$index" ;;
+        esac
+      fi
+      index=$((index + 1)); shift 2
+    done
+  fi
+done
+
+# Per-hart wiring, as parallel arrays indexed by position in PLATFORM_HARTS
+list() {
+  sep=
+  printf '{'
+  for hart in $harts; do
+    eval "printf '%s %s' \"\$sep\" \"\$$1$hart\""
+    sep=,
+  done
+  printf ' }\n'
+}
+
+count=0
+for hart in $harts; do count=$((count + 1)); eval "id_$hart=$hart"; done
+echo
+echo "#define PLATFORM_HART_COUNT $count"
+echo "#define PLATFORM_HARTS $(list id_)"
+echo "#define PLATFORM_CLINT_INDEX $(list clint_)"
+echo "#define PLATFORM_PLIC_M_CONTEXT $(list plic_m_)"
+echo "#define PLATFORM_PLIC_S_CONTEXT $(list plic_s_)"
+echo "#define PLATFORM_SSWI_INDEX $(list sswi_)"
+echo "#define PLATFORM_SSTC $(list sstc_)"
+echo
+echo "#endif"